@@ -9,180 +9,2380 @@
 #include <vector>
 #include <type_traits>
 #include <random>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <algorithm>
 
 #pragma GCC diagnostic push
+#ifdef __clang__
 #pragma GCC diagnostic ignored "-Wcomma"
+#endif
 #pragma GCC diagnostic ignored "-Wconversion"
 #pragma GCC diagnostic ignored "-Wshadow"
+#define STB_VORBIS_SETUP_CACHE
+#define STB_VORBIS_IO_CALLBACKS
 #include "stb_vorbis.h"
 #pragma GCC diagnostic pop
 
-#ifdef AUDIOLIB_BACKEND_AUDIOTOOLBOX
-    #include <AudioToolbox/AudioQueue.h>
-    #include <AVFoundation/AVFoundation.h>
-    #include <AVFoundation/AVAudioSession.h>
-    #include <AVFoundation/AVPlayer.h>
-    #include <AVFoundation/AVAsset.h>
-#elif defined(AUDIOLIB_BACKEND_OPENSLES)
-    #include <SLES/OpenSLES.h>
-    #include <SLES/OpenSLES_Android.h>
+// AUDIOLIB_NO_SIMD forces the scalar paths, e.g. to compare them against the vector ones
+#if defined(AUDIOLIB_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define AUDIOLIB_SSE2
+    #include <emmintrin.h>
+    #ifdef __SSSE3__
+        #define AUDIOLIB_SSSE3
+        #include <tmmintrin.h>
+    #endif
+    #ifdef __AVX__
+        #define AUDIOLIB_AVX
+        #include <immintrin.h>
+    #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define AUDIOLIB_NEON
+    #include <arm_neon.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define AUDIOLIB_MMAP
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <sys/syscall.h>
+        #include <sys/uio.h>
+        #include <linux/io_uring.h>
+        #ifdef __NR_io_uring_setup
+            #define AUDIOLIB_IO_URING
+        #endif
+    #endif
+#endif
+
+#ifdef AUDIOLIB_BACKEND_AUDIOTOOLBOX
+    #include <AudioToolbox/AudioQueue.h>
+    #include <AVFoundation/AVFoundation.h>
+    #include <AVFoundation/AVAudioSession.h>
+    #include <AVFoundation/AVPlayer.h>
+    #include <AVFoundation/AVAsset.h>
+#elif defined(AUDIOLIB_BACKEND_OPENSLES)
+    #include <SLES/OpenSLES.h>
+    #include <SLES/OpenSLES_Android.h>
+#endif
+
+/*
+ */
+
+namespace AudioLib {
+
+class Manager;
+class IOQueue;
+class StreamThread;
+constexpr size_t SAMPLE_SIZE = sizeof(int16_t) * 2;
+constexpr size_t SAMPLE_COUNT = 2048;
+constexpr size_t BUFFER_SIZE = SAMPLE_COUNT * SAMPLE_SIZE;
+constexpr int OUTPUT_FREQ = 44100;
+constexpr size_t MAX_SENDS = 4;
+constexpr size_t RESAMPLE_DELAY = 2;   // source frames sub-bus and load time resampling lag behind
+
+enum {
+    AUDIOLIB_SUCCESS = 0,
+    AUDIOLIB_FILE_ERROR,
+    AUDIOLIB_DECODE_ERROR,
+    AUDIOLIB_WRONG_SAMPLE_RATE,
+    AUDIOLIB_WRONG_CHANNEL_COUNT
+};
+
+// load flags
+enum {
+    AUDIOLIB_LOAD_DEFAULT = 0,
+    AUDIOLIB_LOAD_RESAMPLE = 1 << 0,    // convert to OUTPUT_FREQ at load time, play with a plain copy
+    AUDIOLIB_LOAD_ASYNC = 1 << 1,       // run load time conversions on the decode pool
+    AUDIOLIB_LOAD_COMPRESSED = 1 << 2,  // keep the encoded file in memory and decode while playing
+    AUDIOLIB_LOAD_MMAP = 1 << 3,        // map the encoded file instead of reading it
+    AUDIOLIB_LOAD_ADPCM = 1 << 4,       // keep samples as 4-bit IMA-ADPCM, decoded while playing
+    AUDIOLIB_LOAD_FLOAT = 1 << 5,       // decode OGG to float samples instead of 16 bit
+    AUDIOLIB_LOAD_PARALLEL = 1 << 6,    // decode long OGG files on several threads
+    AUDIOLIB_LOAD_STREAM = 1 << 7,      // decode OGG while playing, reading the file from disk
+    AUDIOLIB_LOAD_PITCHED = 1 << 8,     // keep half-band copies so rates above 1 don't alias, 0.75x the PCM or float size, 2x for a loop of odd length
+};
+
+// sample data formats
+enum {
+    AUDIOLIB_FORMAT_PCM16 = 0,
+    AUDIOLIB_FORMAT_ADPCM,
+    AUDIOLIB_FORMAT_FLOAT,
+};
+
+// voice filter slot types
+enum {
+    AUDIOLIB_FILTER_NONE = 0,
+    AUDIOLIB_FILTER_LOWPASS,
+    AUDIOLIB_FILTER_HIGHPASS,
+    AUDIOLIB_FILTER_BANDPASS,
+    AUDIOLIB_FILTER_ONEPOLE,        // 6 dB/octave lowpass, q is ignored
+};
+
+// Sound::interpolation while the rate isn't 1
+enum {
+    AUDIOLIB_INTERP_LINEAR = 0,
+    AUDIOLIB_INTERP_CUBIC,
+};
+
+// FDNReverb quality presets
+enum {
+    AUDIOLIB_REVERB_LOW = 0,        // 8 lines
+    AUDIOLIB_REVERB_MEDIUM,         // 8 modulated lines
+    AUDIOLIB_REVERB_HIGH,           // 16 modulated lines
+};
+
+// catmull-rom between w[1] and w[2]
+inline float hermite(const float *w, float t) {
+    return w[1] + 0.5f * t * (w[2] - w[0] + t * (2.0f * w[0] - 5.0f * w[1] + 4.0f * w[2] - w[3] + t * (3.0f * (w[1] - w[2]) + w[3] - w[0])));
+}
+
+/************************************************************************
+ * Sample conversion
+ ************************************************************************/
+
+// unsigned 8 bit to 16 bit
+inline void convertU8(const uint8_t *src, int16_t *dst, size_t n) {
+    size_t i = 0;
+#if defined(AUDIOLIB_SSE2)
+    const __m128i bias = _mm_set1_epi8(char(0x80));
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), bias);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(zero, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(zero, v));
+    }
+#elif defined(AUDIOLIB_NEON)
+    for(; i + 16 <= n; i += 16) {
+        int8x16_t v = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(src + i), vdupq_n_u8(0x80)));
+        vst1q_s16(dst + i, vshll_n_s8(vget_low_s8(v), 8));
+        vst1q_s16(dst + i + 8, vshll_n_s8(vget_high_s8(v), 8));
+    }
+#endif
+    for(; i < n; i++) dst[i] = int16_t((src[i] - 128) * 256);
+}
+
+// packed signed 24 bit to float
+inline void convertS24(const uint8_t *src, float *dst, size_t n) {
+    constexpr float scale = 1.0f / 2147483648.0f;
+    size_t i = 0;
+#if defined(AUDIOLIB_SSSE3)
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    for(; i + 6 <= n; i += 4) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3)), shuffle);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(scale)));
+    }
+#elif defined(AUDIOLIB_NEON)
+    for(; i + 8 <= n; i += 8) {
+        uint8x8x3_t v = vld3_u8(src + i * 3);
+        uint16x8_t lo = vshll_n_u8(v.val[0], 8);
+        uint16x8_t hi = vorrq_u16(vshll_n_u8(v.val[2], 8), vmovl_u8(v.val[1]));
+        uint16x8x2_t w = vzipq_u16(lo, hi);
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u16(w.val[0])), scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u16(w.val[1])), scale));
+    }
+#endif
+    for(; i < n; i++) {
+        uint32_t v = (uint32_t(src[i * 3]) << 8) | (uint32_t(src[i * 3 + 1]) << 16) | (uint32_t(src[i * 3 + 2]) << 24);
+        dst[i] = float(int32_t(v)) * scale;
+    }
+}
+
+// signed 32 bit to float, src and dst may alias
+inline void convertS32(const int32_t *src, float *dst, size_t n) {
+    constexpr float scale = 1.0f / 2147483648.0f;
+    size_t i = 0;
+#if defined(AUDIOLIB_SSE2)
+    for(; i + 4 <= n; i += 4) {
+        __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(v, _mm_set1_ps(scale)));
+    }
+#elif defined(AUDIOLIB_NEON)
+    for(; i + 4 <= n; i += 4) {
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), scale));
+    }
+#endif
+    for(; i < n; i++) dst[i] = float(src[i]) * scale;
+}
+
+// float to 16 bit with rounding and saturation
+inline void convertF32(const float *src, int16_t *dst, size_t n) {
+    size_t i = 0;
+#if defined(AUDIOLIB_SSE2)
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    for(; i + 8 <= n; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(AUDIOLIB_NEON) && defined(__aarch64__)
+    for(; i + 8 <= n; i += 8) {
+        int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), 32768.0f));
+        int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), 32768.0f));
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for(; i < n; i++) {
+        float v = std::nearbyint(src[i] * 32768.0f);
+        dst[i] = int16_t(std::min(std::max(v, -32768.0f), 32767.0f));
+    }
+}
+
+/************************************************************************
+ * SIMD lanes
+ ************************************************************************/
+
+// thin wrappers so one kernel can be instantiated for scalar, 4 and 8 float lanes
+namespace simd {
+
+struct Scalar {
+    typedef float type;
+    static constexpr size_t width = 1;
+    static type load(const float *p) { return *p; }
+    static void store(float *p, type v) { *p = v; }
+    static type add(type a, type b) { return a + b; }
+    static type sub(type a, type b) { return a - b; }
+    static type mul(type a, type b) { return a * b; }
+    static type set1(float v) { return v; }
+    static float sum(type v) { return v; }
+    // horizontal sums of three vectors with a single reduction
+    static void sums(type a, type b, type c, float *out) { out[0] = a; out[1] = b; out[2] = c; }
+    static type gather(const float *base, const size_t *index) { return base[index[0]]; }
+    // integer parts of non-negative values to whole, returns the fractional parts
+    static type fraction(type v, int32_t *whole) {
+        whole[0] = int32_t(v);
+        return v - float(whole[0]);
+    }
+};
+#if defined(AUDIOLIB_SSE2)
+struct Vec4 {
+    typedef __m128 type;
+    static constexpr size_t width = 4;
+    static type load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, type v) { _mm_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static type set1(float v) { return _mm_set1_ps(v); }
+    static float sum(type v) {
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+    }
+    static void sums(type a, type b, type c, float *out) {
+        type ab = _mm_add_ps(_mm_unpacklo_ps(a, b), _mm_unpackhi_ps(a, b));
+        type cz = _mm_add_ps(_mm_unpacklo_ps(c, _mm_setzero_ps()), _mm_unpackhi_ps(c, _mm_setzero_ps()));
+        float v[4];
+        _mm_storeu_ps(v, _mm_add_ps(_mm_movelh_ps(ab, cz), _mm_movehl_ps(cz, ab)));
+        memcpy(out, v, 3 * sizeof(float));
+    }
+    static type gather(const float *base, const size_t *index) { return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]); }
+    static type fraction(type v, int32_t *whole) {
+        __m128i i = _mm_cvttps_epi32(v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(whole), i);
+        return _mm_sub_ps(v, _mm_cvtepi32_ps(i));
+    }
+    static void transpose(type &a, type &b, type &c, type &d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+    // two stereo frames side by side, and a value for each
+    static type frames(const float *a, const float *b) {
+        return _mm_loadh_pi(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(a))), reinterpret_cast<const __m64*>(b));
+    }
+    static type pairs(float a, float b) { return _mm_setr_ps(a, a, b, b); }
+};
+#elif defined(AUDIOLIB_NEON)
+struct Vec4 {
+    typedef float32x4_t type;
+    static constexpr size_t width = 4;
+    static type load(const float *p) { return vld1q_f32(p); }
+    static void store(float *p, type v) { vst1q_f32(p, v); }
+    static type add(type a, type b) { return vaddq_f32(a, b); }
+    static type sub(type a, type b) { return vsubq_f32(a, b); }
+    static type mul(type a, type b) { return vmulq_f32(a, b); }
+    static type set1(float v) { return vdupq_n_f32(v); }
+    static float sum(type v) {
+        float32x2_t h = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+        return vget_lane_f32(vpadd_f32(h, h), 0);
+    }
+    static void sums(type a, type b, type c, float *out) {
+        type d = vdupq_n_f32(0.0f);
+        transpose(a, b, c, d);
+        float v[4];
+        vst1q_f32(v, vaddq_f32(vaddq_f32(a, b), vaddq_f32(c, d)));
+        memcpy(out, v, 3 * sizeof(float));
+    }
+    static type gather(const float *base, const size_t *index) {
+        type v = vdupq_n_f32(base[index[0]]);
+        v = vsetq_lane_f32(base[index[1]], v, 1);
+        v = vsetq_lane_f32(base[index[2]], v, 2);
+        return vsetq_lane_f32(base[index[3]], v, 3);
+    }
+    static type fraction(type v, int32_t *whole) {
+        int32x4_t i = vcvtq_s32_f32(v);
+        vst1q_s32(whole, i);
+        return vsubq_f32(v, vcvtq_f32_s32(i));
+    }
+    static void transpose(type &a, type &b, type &c, type &d) {
+        float32x4x2_t ab = vtrnq_f32(a, b), cd = vtrnq_f32(c, d);
+        a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+        b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+        c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+        d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+    }
+    static type frames(const float *a, const float *b) { return vcombine_f32(vld1_f32(a), vld1_f32(b)); }
+    static type pairs(float a, float b) { return vcombine_f32(vdup_n_f32(a), vdup_n_f32(b)); }
+};
+#endif
+#if defined(AUDIOLIB_AVX)
+struct Vec8 {
+    typedef __m256 type;
+    static constexpr size_t width = 8;
+    static type load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, type v) { _mm256_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static type set1(float v) { return _mm256_set1_ps(v); }
+    static float sum(type v) { return Vec4::sum(half(v)); }
+    static void sums(type a, type b, type c, float *out) { Vec4::sums(half(a), half(b), half(c), out); }
+    static type gather(const float *base, const size_t *index) {
+        return _mm256_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]], base[index[4]], base[index[5]], base[index[6]], base[index[7]]);
+    }
+    static type fraction(type v, int32_t *whole) {
+        __m256i i = _mm256_cvttps_epi32(v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(whole), i);
+        return _mm256_sub_ps(v, _mm256_cvtepi32_ps(i));
+    }
+    // upper half added to the lower one
+    static __m128 half(type v) { return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)); }
+};
+#endif
+
+}
+
+/************************************************************************
+ * FFT
+ ************************************************************************/
+
+// power-of-two FFT on split real and imaginary arrays. A plan holds the twiddles and the bit reversal
+// for one size, transforms are unscaled, allocate nothing and can run on several threads at once
+class FFT {
+public:
+    static constexpr size_t MIN_SIZE = 32;
+    static constexpr size_t MAX_SIZE = 65536;
+
+    // shared plan for n, nullptr unless n is a power of two in [MIN_SIZE, MAX_SIZE]
+    static std::shared_ptr<const FFT> get(size_t n) {
+        static std::mutex lock;
+        static std::weak_ptr<const FFT> plans[17];
+        size_t bits = 0;
+        while((size_t(1) << bits) < n) bits++;
+        if(n < MIN_SIZE || n > MAX_SIZE || (size_t(1) << bits) != n) return nullptr;
+        std::lock_guard<std::mutex> guard(lock);
+        std::shared_ptr<const FFT> ret = plans[bits].lock();
+        if(!ret) {
+            ret = std::make_shared<const FFT>(n);
+            plans[bits] = ret;
+        }
+        return ret;
+    }
+
+    explicit FFT(size_t n) : size(n) {
+        build(full, n);
+        build(half, n / 2);
+        // e^(2 pi i k / n) for the real transform passes
+        real_cos.resize(n / 4 + 1);
+        real_sin.resize(n / 4 + 1);
+        for(size_t k = 0; k <= n / 4; k++) {
+            double a = 2.0 * 3.14159265358979323846 * double(k) / double(n);
+            real_cos[k] = float(std::cos(a));
+            real_sin[k] = float(std::sin(a));
+        }
+    }
+
+    size_t getSize() const { return size; }
+
+    // n complex values in place, e^(-2 pi i jk / n)
+    void forward(float *re, float *im) const { run(full, re, im); }
+
+    // n complex values in place, e^(2 pi i jk / n); forward then inverse scales by n
+    void inverse(float *re, float *im) const { run(full, im, re); }
+
+    // n real samples to bins 0..n/2, re and im hold n/2 + 1 values
+    void forwardReal(const float *in, float *re, float *im) const {
+        size_t h = size / 2;
+        for(size_t i = 0; i < h; i++) {
+            re[i] = in[i * 2];
+            im[i] = in[i * 2 + 1];
+        }
+        run(half, re, im);
+        
+        // even and odd samples were packed as real and imaginary part, untangle their spectra
+        float r0 = re[0], i0 = im[0];
+        re[0] = r0 + i0;
+        re[h] = r0 - i0;
+        im[0] = im[h] = 0.0f;
+        for(size_t k = 1; k <= h / 2; k++) {
+            size_t j = h - k;
+            float er = 0.5f * (re[k] + re[j]), ei = 0.5f * (im[k] - im[j]);
+            float odd_r = 0.5f * (im[k] + im[j]), odd_i = 0.5f * (re[j] - re[k]);
+            float c = real_cos[k], s = real_sin[k];
+            float tr = odd_r * c + odd_i * s, ti = odd_i * c - odd_r * s;
+            re[k] = er + tr;
+            im[k] = ei + ti;
+            re[j] = er - tr;
+            im[j] = ti - ei;
+        }
+    }
+
+    // bins 0..n/2 to n real samples, overwriting re and im; forwardReal then inverseReal scales by n
+    void inverseReal(float *re, float *im, float *out) const {
+        size_t h = size / 2;
+        float r0 = re[0], rh = re[h];
+        re[0] = r0 + rh;
+        im[0] = r0 - rh;
+        for(size_t k = 1; k <= h / 2; k++) {
+            size_t j = h - k;
+            float er = re[k] + re[j], ei = im[k] - im[j];
+            float dr = re[k] - re[j], di = im[k] + im[j];
+            float c = real_cos[k], s = real_sin[k];
+            float odd_r = dr * c - di * s, odd_i = dr * s + di * c;
+            re[k] = er - odd_i;
+            im[k] = ei + odd_r;
+            re[j] = er + odd_i;
+            im[j] = odd_r - ei;
+        }
+        run(half, im, re);
+        for(size_t i = 0; i < h; i++) {
+            out[i * 2] = re[i];
+            out[i * 2 + 1] = im[i];
+        }
+    }
+
+private:
+    struct Plan {
+        size_t size = 0;
+        bool radix2 = false;            // odd power of two, one radix-2 pass before the radix-4 ones
+        std::vector<float> twiddles;    // per pass, see radix2() and radix4()
+        std::vector<uint32_t> swaps;    // bit reversal as index pairs
+    };
+
+    static void build(Plan &plan, size_t n) {
+        plan.size = n;
+        plan.radix2 = (n & 0xAAAAAAAA) != 0;
+        auto append = [&](size_t m, size_t count, size_t power) {
+            double w = -2.0 * 3.14159265358979323846 * double(power) / double(m);
+            for(size_t j = 0; j < count; j++) plan.twiddles.push_back(float(std::cos(w * double(j))));
+            for(size_t j = 0; j < count; j++) plan.twiddles.push_back(float(std::sin(w * double(j))));
+        };
+        size_t m = n;
+        if(plan.radix2) {
+            append(n, n / 2, 1);
+            m /= 2;
+        }
+        for(; m > 4; m /= 4) {
+            for(size_t power = 1; power <= 3; power++) append(m, m / 4, power);
+        }
+        for(size_t i = 0, j = 0; i < n; i++) {
+            if(i < j) {
+                plan.swaps.push_back(uint32_t(i));
+                plan.swaps.push_back(uint32_t(j));
+            }
+            size_t bit = n >> 1;
+            for(; j & bit; bit >>= 1) j ^= bit;
+            j |= bit;
+        }
+    }
+
+    // decimation in frequency: radix-4 passes are two radix-2 passes fused, so the output
+    // comes out in plain bit-reversed order
+    static void run(const Plan &plan, float *re, float *im) {
+        size_t n = plan.size, m = n;
+        const float *w = plan.twiddles.data();
+        if(plan.radix2) {
+            radix2(re, im, n, w);
+            w += n;
+            m /= 2;
+        }
+        for(; m > 4; m /= 4) {
+            size_t q = m / 4;
+            radix4(re, im, n, q, w);
+            w += q * 6;
+        }
+        radix4Last(re, im, n);
+        const uint32_t *swap = plan.swaps.data();
+        for(size_t i = 0; i < plan.swaps.size(); i += 2) {
+            std::swap(re[swap[i]], re[swap[i + 1]]);
+            std::swap(im[swap[i]], im[swap[i + 1]]);
+        }
+    }
+
+    // x[j] + x[j+h] and (x[j] - x[j+h]) w^j over the whole array, twiddles as h cosines then h sines
+    template<class V>
+    static void radix2(float *re, float *im, size_t n, const float *w) {
+        size_t h = n / 2;
+        for(size_t j = 0; j < h; j += V::width) {
+            typename V::type ar = V::load(re + j), ai = V::load(im + j);
+            typename V::type br = V::load(re + j + h), bi = V::load(im + j + h);
+            typename V::type dr = V::sub(ar, br), di = V::sub(ai, bi);
+            typename V::type wr = V::load(w + j), wi = V::load(w + h + j);
+            V::store(re + j, V::add(ar, br));
+            V::store(im + j, V::add(ai, bi));
+            V::store(re + j + h, V::sub(V::mul(dr, wr), V::mul(di, wi)));
+            V::store(im + j + h, V::add(V::mul(dr, wi), V::mul(di, wr)));
+        }
+    }
+
+    static void radix2(float *re, float *im, size_t n, const float *w) {
+#if defined(AUDIOLIB_AVX)
+        if(n % 16 == 0) return radix2<simd::Vec8>(re, im, n, w);
+#endif
+#if defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+        if(n % 8 == 0) return radix2<simd::Vec4>(re, im, n, w);
+#endif
+        radix2<simd::Scalar>(re, im, n, w);
+    }
+
+    // groups of 4q, twiddles as q cosines and q sines of w^j, w^2j and w^3j
+    template<class V>
+    static void radix4(float *re, float *im, size_t n, size_t q, const float *w) {
+        for(size_t g = 0; g < n; g += q * 4) {
+            float *r = re + g, *i = im + g;
+            for(size_t j = 0; j < q; j += V::width) {
+                typename V::type ar = V::load(r + j), ai = V::load(i + j);
+                typename V::type br = V::load(r + j + q), bi = V::load(i + j + q);
+                typename V::type cr = V::load(r + j + q * 2), ci = V::load(i + j + q * 2);
+                typename V::type dr = V::load(r + j + q * 3), di = V::load(i + j + q * 3);
+                typename V::type s0r = V::add(ar, cr), s0i = V::add(ai, ci);
+                typename V::type s1r = V::sub(ar, cr), s1i = V::sub(ai, ci);
+                typename V::type s2r = V::add(br, dr), s2i = V::add(bi, di);
+                typename V::type s3r = V::sub(br, dr), s3i = V::sub(bi, di);
+                
+                V::store(r + j, V::add(s0r, s2r));
+                V::store(i + j, V::add(s0i, s2i));
+                
+                // (s0 - s2) w^2j
+                typename V::type xr = V::sub(s0r, s2r), xi = V::sub(s0i, s2i);
+                typename V::type wr = V::load(w + q * 2 + j), wi = V::load(w + q * 3 + j);
+                V::store(r + j + q, V::sub(V::mul(xr, wr), V::mul(xi, wi)));
+                V::store(i + j + q, V::add(V::mul(xr, wi), V::mul(xi, wr)));
+                
+                // (s1 - i s3) w^j
+                xr = V::add(s1r, s3i);
+                xi = V::sub(s1i, s3r);
+                wr = V::load(w + j);
+                wi = V::load(w + q + j);
+                V::store(r + j + q * 2, V::sub(V::mul(xr, wr), V::mul(xi, wi)));
+                V::store(i + j + q * 2, V::add(V::mul(xr, wi), V::mul(xi, wr)));
+                
+                // (s1 + i s3) w^3j
+                xr = V::sub(s1r, s3i);
+                xi = V::add(s1i, s3r);
+                wr = V::load(w + q * 4 + j);
+                wi = V::load(w + q * 5 + j);
+                V::store(r + j + q * 3, V::sub(V::mul(xr, wr), V::mul(xi, wi)));
+                V::store(i + j + q * 3, V::add(V::mul(xr, wi), V::mul(xi, wr)));
+            }
+        }
+    }
+
+    static void radix4(float *re, float *im, size_t n, size_t q, const float *w) {
+#if defined(AUDIOLIB_AVX)
+        if(q % 8 == 0) return radix4<simd::Vec8>(re, im, n, q, w);
+#endif
+#if defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+        if(q % 4 == 0) return radix4<simd::Vec4>(re, im, n, q, w);
+#endif
+        radix4<simd::Scalar>(re, im, n, q, w);
+    }
+
+    // the last pass has no twiddles and works on groups of 4 neighbours, so
+    // vectors take 4 groups and transpose them into lanes
+    static void radix4Last(float *re, float *im, size_t n) {
+        size_t g = 0;
+#if defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+        for(; g + 16 <= n; g += 16) {
+            simd::Vec4::type ar = simd::Vec4::load(re + g), br = simd::Vec4::load(re + g + 4), cr = simd::Vec4::load(re + g + 8), dr = simd::Vec4::load(re + g + 12);
+            simd::Vec4::type ai = simd::Vec4::load(im + g), bi = simd::Vec4::load(im + g + 4), ci = simd::Vec4::load(im + g + 8), di = simd::Vec4::load(im + g + 12);
+            simd::Vec4::transpose(ar, br, cr, dr);
+            simd::Vec4::transpose(ai, bi, ci, di);
+            simd::Vec4::type s0r = simd::Vec4::add(ar, cr), s0i = simd::Vec4::add(ai, ci);
+            simd::Vec4::type s1r = simd::Vec4::sub(ar, cr), s1i = simd::Vec4::sub(ai, ci);
+            simd::Vec4::type s2r = simd::Vec4::add(br, dr), s2i = simd::Vec4::add(bi, di);
+            simd::Vec4::type s3r = simd::Vec4::sub(br, dr), s3i = simd::Vec4::sub(bi, di);
+            ar = simd::Vec4::add(s0r, s2r); ai = simd::Vec4::add(s0i, s2i);
+            br = simd::Vec4::sub(s0r, s2r); bi = simd::Vec4::sub(s0i, s2i);
+            cr = simd::Vec4::add(s1r, s3i); ci = simd::Vec4::sub(s1i, s3r);
+            dr = simd::Vec4::sub(s1r, s3i); di = simd::Vec4::add(s1i, s3r);
+            simd::Vec4::transpose(ar, br, cr, dr);
+            simd::Vec4::transpose(ai, bi, ci, di);
+            simd::Vec4::store(re + g, ar); simd::Vec4::store(re + g + 4, br); simd::Vec4::store(re + g + 8, cr); simd::Vec4::store(re + g + 12, dr);
+            simd::Vec4::store(im + g, ai); simd::Vec4::store(im + g + 4, bi); simd::Vec4::store(im + g + 8, ci); simd::Vec4::store(im + g + 12, di);
+        }
+#endif
+        for(; g < n; g += 4) {
+            float *r = re + g, *i = im + g;
+            float s0r = r[0] + r[2], s0i = i[0] + i[2];
+            float s1r = r[0] - r[2], s1i = i[0] - i[2];
+            float s2r = r[1] + r[3], s2i = i[1] + i[3];
+            float s3r = r[1] - r[3], s3i = i[1] - i[3];
+            r[0] = s0r + s2r; i[0] = s0i + s2i;
+            r[1] = s0r - s2r; i[1] = s0i - s2i;
+            r[2] = s1r + s3i; i[2] = s1i - s3r;
+            r[3] = s1r - s3i; i[3] = s1i + s3r;
+        }
+    }
+
+    size_t size;
+    Plan full, half;
+    std::vector<float> real_cos, real_sin;
+};
+
+/************************************************************************
+ * Files
+ ************************************************************************/
+
+// read-only image of a whole file, either mapped or copied into memory
+struct MappedFile {
+    MappedFile() { }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &filename, bool map) {
+        close();
+#ifdef AUDIOLIB_MMAP
+        if(map) {
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if(fd < 0) return false;
+            struct stat st;
+            if(fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if(p != MAP_FAILED) {
+                    data = static_cast<const uint8_t*>(p);
+                    size = size_t(st.st_size);
+                    mapped = true;
+                }
+            }
+            ::close(fd);
+            return mapped;
+        }
+#endif
+        FILE *file = fopen(filename.c_str(), "rb");
+        if(!file) return false;
+        fseek(file,0,SEEK_END);
+        long length = ftell(file);
+        fseek(file,0,SEEK_SET);
+        if(length > 0) {
+            uint8_t *p = new uint8_t[length];
+            if(fread(p,length,1,file)) {
+                data = p;
+                size = size_t(length);
+            } else {
+                delete [] p;
+            }
+        }
+        fclose(file);
+        return data != nullptr;
+    }
+
+    void close() {
+#ifdef AUDIOLIB_MMAP
+        if(mapped) munmap(const_cast<uint8_t*>(data), size);
+        else
+#endif
+        delete [] data;
+        data = nullptr;
+        size = 0;
+        mapped = false;
+    }
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+};
+
+// 64 bit FNV-1a
+inline uint64_t hashBytes(const uint8_t *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    for(size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+// byte source the decoders read sounds from
+struct Reader {
+    virtual ~Reader() { }
+    // copies up to bytes from the current position, fewer only at the end
+    virtual size_t read(void *dst, size_t bytes) = 0;
+    virtual bool seek(size_t offset) = 0;
+    virtual size_t tell() const = 0;
+    virtual size_t size() const = 0;
+    // the whole contents when they are in memory
+    virtual const uint8_t *map() const { return nullptr; }
+    // another reader of the same bytes with its own position, for a second decoder
+    virtual std::unique_ptr<Reader> clone() const = 0;
+    // memory held for reading
+    virtual size_t getMemorySize() const = 0;
+};
+
+// bytes in memory, kept alive by owner when it is set
+class MemoryReader : public Reader {
+public:
+    MemoryReader(const uint8_t *_data, size_t _size, std::shared_ptr<MappedFile> _owner = nullptr) : data(_data), length(_size), owner(std::move(_owner)) { }
+
+    size_t read(void *dst, size_t bytes) override {
+        size_t n = std::min(bytes, length - pos);
+        memcpy(dst, data + pos, n);
+        pos += n;
+        return n;
+    }
+    bool seek(size_t offset) override {
+        if(offset > length) return false;
+        pos = offset;
+        return true;
+    }
+    size_t tell() const override { return pos; }
+    size_t size() const override { return length; }
+    const uint8_t *map() const override { return data; }
+    std::unique_ptr<Reader> clone() const override { return std::unique_ptr<Reader>(new MemoryReader(data, length, owner)); }
+    size_t getMemorySize() const override { return length; }
+
+private:
+    const uint8_t *data;
+    size_t length;
+    size_t pos = 0;
+    std::shared_ptr<MappedFile> owner;
+};
+
+// file read through one large buffer filled from aligned offsets, so sequential reads turn into a few big ones
+class FileReader : public Reader {
+public:
+    static constexpr size_t READ_AHEAD = 256 * 1024;
+    static constexpr size_t ALIGN = 4096;
+
+    FileReader() { }
+    FileReader(const FileReader&) = delete;
+    FileReader &operator=(const FileReader&) = delete;
+    ~FileReader() { close(); }
+
+    bool open(const std::string &_filename, size_t read_ahead = READ_AHEAD) {
+        close();
+#ifdef AUDIOLIB_MMAP
+        fd = ::open(_filename.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0) return close(), false;
+        length = size_t(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+        file = fopen(_filename.c_str(), "rb");
+        if(!file) return false;
+        setvbuf(file, nullptr, _IONBF, 0);
+        fseek(file,0,SEEK_END);
+        length = size_t(ftell(file));
+#endif
+        filename = _filename;
+        buffer.resize(std::max<size_t>((read_ahead + ALIGN - 1) / ALIGN, 1) * ALIGN);
+        return true;
+    }
+
+    void close() {
+#ifdef AUDIOLIB_MMAP
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+#else
+        if(file) fclose(file);
+        file = nullptr;
+#endif
+        length = pos = buffer_offset = buffer_size = 0;
+    }
+
+    size_t read(void *dst, size_t bytes) override {
+        uint8_t *out = static_cast<uint8_t*>(dst);
+        size_t done = 0;
+        bytes = std::min(bytes, length - std::min(pos, length));
+        while(done < bytes) {
+            if(pos >= buffer_offset && pos < buffer_offset + buffer_size) {
+                size_t n = std::min(bytes - done, buffer_offset + buffer_size - pos);
+                memcpy(out + done, buffer.data() + (pos - buffer_offset), n);
+                done += n;
+                pos += n;
+            } else if(bytes - done >= buffer.size()) {
+                // reads as big as the buffer go straight to dst
+                size_t n = readAt(out + done, bytes - done, pos);
+                done += n;
+                pos += n;
+                if(!n) break;
+            } else {
+                buffer_offset = pos / ALIGN * ALIGN;
+                buffer_size = readAt(buffer.data(), buffer.size(), buffer_offset);
+                if(buffer_offset + buffer_size <= pos) break;
+            }
+        }
+        return done;
+    }
+    bool seek(size_t offset) override {
+        if(offset > length) return false;
+        pos = offset;
+        return true;
+    }
+    size_t tell() const override { return pos; }
+    size_t size() const override { return length; }
+    std::unique_ptr<Reader> clone() const override {
+        std::unique_ptr<FileReader> ret(new FileReader());
+        if(!ret->open(filename, buffer.size())) return nullptr;
+        return std::unique_ptr<Reader>(std::move(ret));
+    }
+    size_t getMemorySize() const override { return buffer.size(); }
+
+private:
+    size_t readAt(uint8_t *dst, size_t bytes, size_t offset) {
+        size_t done = 0;
+#ifdef AUDIOLIB_MMAP
+        while(done < bytes) {
+            ssize_t n = pread(fd, dst + done, bytes - done, off_t(offset + done));
+            if(n <= 0) break;
+            done += size_t(n);
+        }
+#else
+        if(fseek(file, long(offset), SEEK_SET) == 0) done = fread(dst, 1, bytes, file);
+#endif
+        return done;
+    }
+
+    std::string filename;
+#ifdef AUDIOLIB_MMAP
+    int fd = -1;
+#else
+    FILE *file = nullptr;
+#endif
+    size_t length = 0;
+    size_t pos = 0;
+    std::vector<uint8_t> buffer;
+    size_t buffer_offset = 0;
+    size_t buffer_size = 0;
+};
+
+// part of another reader, such as one file inside an archive
+class SubRangeReader : public Reader {
+public:
+    SubRangeReader(std::unique_ptr<Reader> _parent, size_t _offset, size_t _size) : parent(std::move(_parent)), offset(_offset) {
+        size_t parent_size = parent ? parent->size() : 0;
+        offset = std::min(offset, parent_size);
+        length = std::min(_size, parent_size - offset);
+    }
+
+    size_t read(void *dst, size_t bytes) override {
+        if(!parent || !parent->seek(offset + pos)) return 0;
+        size_t n = parent->read(dst, std::min(bytes, length - pos));
+        pos += n;
+        return n;
+    }
+    bool seek(size_t _offset) override {
+        if(_offset > length) return false;
+        pos = _offset;
+        return true;
+    }
+    size_t tell() const override { return pos; }
+    size_t size() const override { return length; }
+    const uint8_t *map() const override {
+        const uint8_t *p = parent ? parent->map() : nullptr;
+        return p ? p + offset : nullptr;
+    }
+    std::unique_ptr<Reader> clone() const override {
+        auto p = parent ? parent->clone() : nullptr;
+        if(!p) return nullptr;
+        return std::unique_ptr<Reader>(new SubRangeReader(std::move(p), offset, length));
+    }
+    size_t getMemorySize() const override { return parent ? parent->getMemorySize() : 0; }
+
+private:
+    std::unique_ptr<Reader> parent;
+    size_t offset;
+    size_t length = 0;
+    size_t pos = 0;
+};
+
+// whole file in memory, mapped when map is set
+inline std::unique_ptr<Reader> openMapped(const std::string &filename, bool map) {
+    auto file = std::make_shared<MappedFile>();
+    if(!file->open(filename, map)) return nullptr;
+    return std::unique_ptr<Reader>(new MemoryReader(file->data, file->size, file));
+}
+
+inline std::unique_ptr<Reader> openFile(const std::string &filename, size_t read_ahead = FileReader::READ_AHEAD) {
+    std::unique_ptr<FileReader> ret(new FileReader());
+    if(!ret->open(filename, read_ahead)) return nullptr;
+    return std::unique_ptr<Reader>(std::move(ret));
+}
+
+/************************************************************************
+ * Async I/O
+ ************************************************************************/
+
+#ifdef AUDIOLIB_MMAP
+// file reads done in the background for any number of streams, through io_uring where the kernel has it
+// and a few threads calling pread otherwise; submit() only queues, flush() passes everything queued to the
+// kernel in one call
+class IOQueue {
+public:
+    struct Request {
+        int fd = -1;
+        uint8_t *data = nullptr;
+        size_t size = 0;
+        uint64_t offset = 0;
+        size_t result = 0;              // bytes read, set before done
+        std::atomic<bool> done{true};
+#ifdef AUDIOLIB_IO_URING
+        iovec iov;
+#endif
+    };
+
+    explicit IOQueue(size_t threads = 2, bool use_uring = true) {
+#ifdef AUDIOLIB_IO_URING
+        if(use_uring && ring.init(RING_ENTRIES)) {
+            workers.emplace_back([this] { reap(); });
+            return;
+        }
+#endif
+        for(size_t i = 0; i < std::max<size_t>(threads, 1); i++) workers.emplace_back([this] { work(); });
+    }
+
+    ~IOQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+#ifdef AUDIOLIB_IO_URING
+            // a nop wakes the reaper
+            if(isUring()) {
+                pending.push_back(nullptr);
+                fillRing();
+            }
+#endif
+        }
+        cv.notify_all();
+        for(auto &thread : workers) thread.join();
+#ifdef AUDIOLIB_IO_URING
+        ring.close();
+#endif
+    }
+
+    void submit(Request *r) {
+        r->result = 0;
+        r->done.store(false, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(r);
+        if(!isUring()) cv.notify_one();
+    }
+
+    void flush() {
+#ifdef AUDIOLIB_IO_URING
+        if(!isUring()) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        fillRing();
+#endif
+    }
+
+    void wait(Request &r) {
+        if(r.done.load(std::memory_order_acquire)) return;
+        flush();
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [&r] { return r.done.load(std::memory_order_acquire); });
+    }
+
+    bool isUring() const {
+#ifdef AUDIOLIB_IO_URING
+        return ring.fd >= 0;
+#else
+        return false;
+#endif
+    }
+
+private:
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            cv.wait(lock, [this] { return quit || !pending.empty(); });
+            if(pending.empty()) return;
+            Request *r = pending.front();
+            pending.pop_front();
+            lock.unlock();
+            size_t done = 0;
+            while(done < r->size) {
+                ssize_t n = pread(r->fd, r->data + done, r->size - done, off_t(r->offset + done));
+                if(n <= 0) break;
+                done += size_t(n);
+            }
+            lock.lock();
+            r->result = done;
+            r->done.store(true, std::memory_order_release);
+            done_cv.notify_all();
+        }
+    }
+
+#ifdef AUDIOLIB_IO_URING
+    // rings shared with the kernel, set up with raw syscalls
+    struct Ring {
+        bool init(unsigned n) {
+            io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            fd = int(syscall(__NR_io_uring_setup, n, &p));
+            if(fd < 0) return false;
+            sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if(single) sq_size = cq_size = std::max(sq_size, cq_size);
+            sq = map(sq_size, IORING_OFF_SQ_RING);
+            cq = single ? sq : map(cq_size, IORING_OFF_CQ_RING);
+            sqes = reinterpret_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+            if(!sq || !cq || !sqes) return close(), false;
+            sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+            sq_entries = p.sq_entries;
+            cq_entries = p.cq_entries;
+            return true;
+        }
+
+        void close() {
+            if(sqes) munmap(sqes, sqes_size);
+            if(cq && cq != sq) munmap(cq, cq_size);
+            if(sq) munmap(sq, sq_size);
+            if(fd >= 0) ::close(fd);
+            sq = cq = nullptr;
+            sqes = nullptr;
+            fd = -1;
+        }
+
+        int enter(unsigned submit, unsigned wait) {
+            return int(syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+        }
+
+        uint8_t *map(size_t size, uint64_t offset) {
+            void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, off_t(offset));
+            return p == MAP_FAILED ? nullptr : static_cast<uint8_t*>(p);
+        }
+
+        int fd = -1;
+        uint8_t *sq = nullptr, *cq = nullptr;
+        size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+        unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr, *cq_head = nullptr, *cq_tail = nullptr;
+        unsigned sq_mask = 0, cq_mask = 0, sq_entries = 0, cq_entries = 0;
+        io_uring_sqe *sqes = nullptr;
+        io_uring_cqe *cqes = nullptr;
+    };
+
+    // moves queued reads into the submission ring, never more in flight than the completion ring holds;
+    // called with mutex held
+    void fillRing() {
+        unsigned tail = *ring.sq_tail;
+        unsigned head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        bool added = false;
+        while(!pending.empty() && tail - head < ring.sq_entries && in_flight < ring.cq_entries) {
+            Request *r = pending.front();
+            pending.pop_front();
+            unsigned index = tail & ring.sq_mask;
+            io_uring_sqe &sqe = ring.sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            if(r) {
+                r->iov.iov_base = r->data;
+                r->iov.iov_len = r->size;
+                sqe.opcode = IORING_OP_READV;
+                sqe.fd = r->fd;
+                sqe.addr = uint64_t(uintptr_t(&r->iov));
+                sqe.len = 1;
+                sqe.off = r->offset;
+            } else {
+                sqe.opcode = IORING_OP_NOP;
+            }
+            sqe.user_data = uint64_t(uintptr_t(r));
+            ring.sq_array[index] = index;
+            tail++;
+            in_flight++;
+            added = true;
+        }
+        if(added) __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        // also passes on entries an interrupted enter left in the ring
+        unsigned unsubmitted = tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        if(unsubmitted) ring.enter(unsubmitted, 0);
+    }
+
+    void reap() {
+        for(;;) {
+            ring.enter(0, 1);
+            std::lock_guard<std::mutex> lock(mutex);
+            unsigned head = *ring.cq_head;
+            unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+            bool stop = false;
+            for(; head != tail; head++) {
+                const io_uring_cqe &cqe = ring.cqes[head & ring.cq_mask];
+                Request *r = reinterpret_cast<Request*>(uintptr_t(cqe.user_data));
+                in_flight--;
+                if(!r) {
+                    stop = true;
+                    continue;
+                }
+                r->result = cqe.res > 0 ? size_t(cqe.res) : 0;
+                r->done.store(true, std::memory_order_release);
+            }
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+            done_cv.notify_all();
+            if(stop) return;
+            fillRing();
+        }
+    }
+
+    static constexpr unsigned RING_ENTRIES = 256;
+    Ring ring;
+    unsigned in_flight = 0;
+#endif
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable done_cv;
+    std::deque<Request*> pending;
+    std::vector<std::thread> workers;
+    bool quit = false;
+};
+
+// file read through an IOQueue: while the decoder works through one chunk the next ones are already
+// being read, so the stream thread only waits for the disk when a voice starts or seeks
+class StreamReader : public Reader {
+public:
+    static constexpr size_t CHUNK = 64 * 1024;
+    static constexpr size_t CHUNKS = 2;
+
+    explicit StreamReader(std::shared_ptr<IOQueue> _queue) : queue(std::move(_queue)) { }
+    StreamReader(const StreamReader&) = delete;
+    StreamReader &operator=(const StreamReader&) = delete;
+    ~StreamReader() { close(); }
+
+    bool open(const std::string &_filename) {
+        close();
+        fd = ::open(_filename.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0) return close(), false;
+        length = size_t(st.st_size);
+        filename = _filename;
+        chunks.reset(new Chunk[CHUNKS]);
+        for(size_t i = 0; i < CHUNKS; i++) chunks[i].data.resize(CHUNK);
+        return true;
+    }
+
+    // the kernel may still be writing into the chunks
+    void close() {
+        if(chunks) {
+            for(size_t i = 0; i < CHUNKS; i++) queue->wait(chunks[i].request);
+        }
+        chunks.reset();
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+        length = pos = 0;
+    }
+
+    size_t read(void *dst, size_t bytes) override {
+        uint8_t *out = static_cast<uint8_t*>(dst);
+        size_t done = 0;
+        bytes = std::min(bytes, length - std::min(pos, length));
+        while(done < bytes) {
+            const Chunk &c = fetch(pos / CHUNK * CHUNK);
+            if(c.offset + c.request.result <= pos) break;
+            size_t n = std::min(bytes - done, size_t(c.offset + c.request.result - pos));
+            memcpy(out + done, c.data.data() + (pos - c.offset), n);
+            done += n;
+            pos += n;
+        }
+        prefetch();
+        return done;
+    }
+    bool seek(size_t offset) override {
+        if(offset > length) return false;
+        pos = offset;
+        return true;
+    }
+    size_t tell() const override { return pos; }
+    size_t size() const override { return length; }
+    std::unique_ptr<Reader> clone() const override {
+        std::unique_ptr<StreamReader> ret(new StreamReader(queue));
+        if(!ret->open(filename)) return nullptr;
+        return std::unique_ptr<Reader>(std::move(ret));
+    }
+    size_t getMemorySize() const override { return chunks ? CHUNKS * CHUNK : 0; }
+
+private:
+    struct Chunk {
+        uint64_t offset = UINT64_MAX;
+        std::vector<uint8_t> data;
+        IOQueue::Request request;
+    };
+
+    Chunk *find(uint64_t offset) {
+        for(size_t i = 0; i < CHUNKS; i++) {
+            if(chunks[i].offset == offset) return &chunks[i];
+        }
+        return nullptr;
+    }
+
+    // reuses the oldest chunk, but not the one being read
+    Chunk &issue(uint64_t offset) {
+        if(chunks[next].offset == pos / CHUNK * CHUNK) next = (next + 1) % CHUNKS;
+        Chunk &c = chunks[next];
+        next = (next + 1) % CHUNKS;
+        queue->wait(c.request);
+        c.offset = offset;
+        c.request.fd = fd;
+        c.request.data = c.data.data();
+        c.request.size = size_t(std::min(uint64_t(CHUNK), uint64_t(length - offset)));
+        c.request.offset = offset;
+        queue->submit(&c.request);
+        return c;
+    }
+
+    const Chunk &fetch(uint64_t offset) {
+        Chunk *c = find(offset);
+        if(!c) c = &issue(offset);
+        queue->wait(c->request);
+        return *c;
+    }
+
+    void prefetch() {
+        for(size_t i = 1; i < CHUNKS; i++) {
+            uint64_t offset = (pos / CHUNK + i) * CHUNK;
+            if(offset >= length) break;
+            if(!find(offset)) issue(offset);
+        }
+    }
+
+    std::shared_ptr<IOQueue> queue;
+    std::string filename;
+    int fd = -1;
+    size_t length = 0;
+    size_t pos = 0;
+    std::unique_ptr<Chunk[]> chunks;
+    size_t next = 0;
+};
+
+inline std::unique_ptr<Reader> openStream(const std::string &filename, const std::shared_ptr<IOQueue> &queue) {
+    std::unique_ptr<StreamReader> ret(new StreamReader(queue));
+    if(!ret->open(filename)) return nullptr;
+    return std::unique_ptr<Reader>(std::move(ret));
+}
+#endif
+
+// decodes AUDIOLIB_LOAD_STREAM sounds ahead of playback, so the audio thread neither waits for the disk nor
+// runs the decoder. The mixer wakes it after every block; a wake that comes while it is busy is picked up
+// PERIOD_MS later at the latest
+class StreamThread {
+public:
+    static constexpr int PERIOD_MS = 10;
+
+    StreamThread() : thread([this] { work(); }) { }
+    StreamThread(const StreamThread&) = delete;
+    StreamThread &operator=(const StreamThread&) = delete;
+
+    ~StreamThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    // fills once on the calling thread, so a sound played right after loading already has samples
+    void add(const void *owner, std::function<void()> refill) {
+        std::lock_guard<std::mutex> lock(mutex);
+        refill();
+        streams.push_back(Stream { owner, std::move(refill) });
+    }
+
+    // waits for a refill that is running, none starts afterwards
+    void remove(const void *owner) {
+        std::lock_guard<std::mutex> lock(mutex);
+        streams.erase(std::remove_if(streams.begin(), streams.end(), [owner](const Stream &s) { return s.owner == owner; }), streams.end());
+    }
+
+    // audio thread, doesn't take the lock
+    void wake() { cv.notify_one(); }
+
+private:
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(!quit) {
+            for(auto &s : streams) s.refill();
+            cv.wait_for(lock, std::chrono::milliseconds(int(PERIOD_MS)));
+        }
+    }
+
+    struct Stream {
+        const void *owner;
+        std::function<void()> refill;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Stream> streams;
+    bool quit = false;
+    std::thread thread;         // last, so it starts after the rest
+};
+
+/************************************************************************
+ * IMA-ADPCM
+ ************************************************************************/
+
+static constexpr int16_t adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static constexpr int8_t adpcm_indices[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// frames per block in the WAV (Microsoft IMA) layout
+inline size_t adpcmBlockFrames(uint32_t block_align, int channels) {
+    return (block_align - 4 * channels) * 2 / channels + 1;
+}
+
+inline int16_t adpcmDecode(int32_t &predictor, int32_t &index, uint32_t nibble) {
+    int32_t step = adpcm_steps[index];
+    int32_t diff = (step >> 3) + (step & -int32_t(nibble >> 2 & 1)) + ((step >> 1) & -int32_t(nibble >> 1 & 1)) + ((step >> 2) & -int32_t(nibble & 1));
+    diff = (diff ^ -int32_t(nibble >> 3)) + int32_t(nibble >> 3);
+    predictor = std::min(std::max(predictor + diff, -32768), 32767);
+    index = std::min(std::max(index + adpcm_indices[nibble], 0), 88);
+    return int16_t(predictor);
+}
+
+inline uint32_t adpcmEncode(int32_t &predictor, int32_t &index, int32_t sample) {
+    int32_t step = adpcm_steps[index];
+    int32_t diff = sample - predictor;
+    uint32_t nibble = 0;
+    if(diff < 0) { nibble = 8; diff = -diff; }
+    if(diff >= step) { nibble |= 4; diff -= step; }
+    if(diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+    if(diff >= step >> 2) nibble |= 1;
+    adpcmDecode(predictor, index, nibble);
+    return nibble;
+}
+
+// decodes the first frames of a block into interleaved samples
+inline void adpcmDecodeBlock(const uint8_t *src, int channels, size_t frames, int16_t *dst) {
+    for(int c = 0; c < channels; c++) {
+        const uint8_t *header = src + c * 4;
+        int32_t predictor = int16_t(header[0] | (header[1] << 8));
+        int32_t index = std::min<int32_t>(header[2], 88);
+        int16_t *out = dst + c;
+        *out = int16_t(predictor);
+        const uint8_t *p = src + (channels + c) * 4;
+        for(size_t i = 1; i < frames; i += 8, p += channels * 4) {
+            uint32_t bits = p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+            size_t n = std::min<size_t>(8, frames - i);
+            for(size_t j = 0; j < n; j++, bits >>= 4) {
+                out += channels;
+                *out = adpcmDecode(predictor, index, bits & 15);
+            }
+        }
+    }
+}
+
+// step index whose step covers the largest sample delta at the start of a block
+inline int32_t adpcmSeedIndex(const int16_t *in, size_t n, int channels) {
+    int32_t delta = 0;
+    for(size_t i = 1; i < std::min<size_t>(n, 5); i++) delta = std::max(delta, std::abs(in[i * channels] - in[(i - 1) * channels]));
+    int32_t index = 0;
+    while(index < 88 && adpcm_steps[index] < delta) index++;
+    return index;
+}
+
+// encodes one channel of a block into p starting from index, returns the squared error
+inline uint64_t adpcmEncodeChannel(const int16_t *in, size_t n, int channels, int32_t &index, uint8_t *p) {
+    int32_t predictor = in[0];
+    uint64_t error = 0;
+    for(size_t i = 1; i < n; i++) {
+        size_t j = i - 1;
+        uint32_t nibble = adpcmEncode(predictor, index, in[i * channels]);
+        p[(j / 8) * channels * 4 + (j % 8) / 2] |= uint8_t(nibble << ((j & 1) * 4));
+        int64_t e = in[i * channels] - predictor;
+        error += uint64_t(e * e);
+    }
+    return error;
+}
+
+// every block starts from the step index the previous one ended on or one seeded from its first
+// samples, whichever encodes it with less error; the first block only has the seeded one
+inline uint8_t *adpcmEncodeBlocks(const int16_t *src, size_t frames, int channels, uint32_t block_align, size_t &out_size) {
+    size_t block_frames = adpcmBlockFrames(block_align, channels);
+    size_t blocks = (frames + block_frames - 1) / block_frames;
+    out_size = blocks * block_align;
+    uint8_t *ret = new uint8_t[out_size]();
+    std::vector<uint8_t> trial(block_align);
+    int32_t indices[2] = { -1, -1 };
+    for(size_t b = 0; b < blocks; b++) {
+        uint8_t *block = ret + b * block_align;
+        const int16_t *in = src + b * block_frames * channels;
+        size_t n = std::min(block_frames, frames - b * block_frames);
+        for(int c = 0; c < channels; c++) {
+            int32_t start = adpcmSeedIndex(in + c, n, channels);
+            int32_t index = start;
+            uint8_t *p = block + (channels + c) * 4;
+            uint64_t error = adpcmEncodeChannel(in + c, n, channels, index, p);
+            if(indices[c] >= 0 && indices[c] != start) {
+                int32_t carried = indices[c];
+                std::fill(trial.begin(), trial.end(), 0);
+                if(adpcmEncodeChannel(in + c, n, channels, indices[c], trial.data()) < error) {
+                    for(size_t j = 0; j < block_align - (channels + c) * 4; j += channels * 4) std::copy(&trial[j], &trial[j] + 4, p + j);
+                    start = carried;
+                    index = indices[c];
+                }
+            }
+            indices[c] = index;
+            block[c * 4 + 0] = uint8_t(in[c]);
+            block[c * 4 + 1] = uint8_t(in[c] >> 8);
+            block[c * 4 + 2] = uint8_t(start);
+        }
+    }
+    return ret;
+}
+
+/************************************************************************
+ * Sound bank
+ ************************************************************************/
+
+// sample data as a sound keeps it in memory
+struct SampleInfo {
+    uint64_t size;
+    uint64_t length;
+    int32_t format, channels, freq, bps;
+    uint32_t block_align, resampled;
+    float duration_sec;
+    uint32_t reserved;
+};
+
+// samples described by info fit in available bytes and can be played as they are, useSamples() trusts every field
+inline bool checkSampleInfo(const SampleInfo &info, uint64_t available) {
+    if(info.size > available || info.channels < 1 || info.channels > 2) return false;
+    if(info.freq != 44100 && info.freq != 22050 && info.freq != 11025) return false;
+    if(!info.length || info.length % uint64_t(info.channels)) return false;
+    switch(info.format) {
+        case AUDIOLIB_FORMAT_PCM16: return info.size % sizeof(int16_t) == 0 && info.size / sizeof(int16_t) == info.length;
+        case AUDIOLIB_FORMAT_FLOAT: return info.size % sizeof(float) == 0 && info.size / sizeof(float) == info.length;
+        case AUDIOLIB_FORMAT_ADPCM:
+            if(info.block_align <= 4 * uint32_t(info.channels)) return false;
+            return info.length / uint64_t(info.channels) <= info.size / info.block_align * adpcmBlockFrames(info.block_align, info.channels);
+    }
+    return false;
+}
+
+// bank entry types
+enum {
+    AUDIOLIB_BANK_SAMPLES = 0,  // samples in the format given by info, used in place
+    AUDIOLIB_BANK_OGG,          // encoded file with its seek index
+};
+
+// bank layout: header, entries sorted by name hash, names, then every entry's
+// seek points (16 byte aligned) and payload (64 byte aligned)
+struct BankHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct BankEntry {
+    uint64_t hash;              // hashBytes of the name
+    uint64_t offset;            // payload
+    uint64_t size;
+    uint64_t seek_offset;       // stb_vorbis_seek_point table
+    uint32_t seek_count;
+    uint32_t type;
+    uint32_t name_offset;
+    uint32_t name_size;
+    SampleInfo info;            // OGG entries only have channels, freq, length and duration
+};
+static_assert(sizeof(BankEntry) == 96, "bank entries are written as is");
+
+constexpr uint32_t BANK_MAGIC = 0x4B4E4241;    // ABNK
+constexpr uint32_t BANK_VERSION = 1;
+
+// many sounds in one mapped file, looked up by name
+class Bank {
+public:
+    bool open(const std::string &path) {
+        auto image = std::make_shared<MappedFile>();
+        if(!image->open(path, true) || image->size < sizeof(BankHeader)) return false;
+        const BankHeader *header = reinterpret_cast<const BankHeader*>(image->data);
+        size_t index_end = sizeof(BankHeader) + size_t(header->count) * sizeof(BankEntry);
+        if(header->magic != BANK_MAGIC || header->version != BANK_VERSION || index_end > image->size) return false;
+        const BankEntry *index = reinterpret_cast<const BankEntry*>(image->data + sizeof(BankHeader));
+        for(uint32_t i = 0; i < header->count; i++) {
+            const BankEntry &e = index[i];
+            if(e.offset > image->size || e.size > image->size - e.offset) return false;
+            if(e.seek_offset > image->size || e.seek_count > (image->size - e.seek_offset) / sizeof(stb_vorbis_seek_point)) return false;
+            if(e.name_offset > image->size || e.name_size > image->size - e.name_offset) return false;
+            if(e.type == AUDIOLIB_BANK_SAMPLES ? !checkSampleInfo(e.info, e.size) : e.type != AUDIOLIB_BANK_OGG) return false;
+        }
+        file = image;
+        entries = index;
+        count = header->count;
+        return true;
+    }
+
+    const BankEntry *find(const std::string &name) const {
+        uint64_t hash = hashBytes(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+        auto it = std::lower_bound(entries, entries + count, hash, [](const BankEntry &e, uint64_t h) { return e.hash < h; });
+        for(; it != entries + count && it->hash == hash; ++it) {
+            if(it->name_size == name.size() && !memcmp(file->data + it->name_offset, name.data(), name.size())) return it;
+        }
+        return nullptr;
+    }
+
+    std::string getName(const BankEntry &e) const { return std::string(reinterpret_cast<const char*>(file->data + e.name_offset), e.name_size); }
+    const uint8_t *getData(const BankEntry &e) const { return file->data + e.offset; }
+    const stb_vorbis_seek_point *getSeekPoints(const BankEntry &e) const { return reinterpret_cast<const stb_vorbis_seek_point*>(file->data + e.seek_offset); }
+    const std::shared_ptr<MappedFile> &getFile() const { return file; }
+    size_t getCount() const { return count; }
+
+private:
+    std::shared_ptr<MappedFile> file;
+    const BankEntry *entries = nullptr;
+    size_t count = 0;
+};
+
+/************************************************************************
+ * Filters
+ ************************************************************************/
+
+struct Filter {
+    virtual ~Filter() { }
+    
+    // interleaved stereo float in place, freq is the rate of the bus the filter sits on
+    virtual void process(float *data, size_t frames, int freq) = 0;
+};
+
+// filters run in order on a voice or on the master bus. Edits copy the list and swap it in,
+// then wait until the audio thread is done with the old one, so the audio thread never blocks
+// and a filter can be destroyed as soon as remove() returns
+class FilterChain {
+public:
+    FilterChain() { }
+    FilterChain(const FilterChain&) = delete;
+    FilterChain &operator=(const FilterChain&) = delete;
+    ~FilterChain() { delete current.load(); }
+
+    // filters stay owned by the caller, index past the end appends
+    void insert(Filter *filter, size_t index = SIZE_MAX) {
+        update([&](std::vector<Filter*> &list) { list.insert(list.begin() + std::min(index, list.size()), filter); });
+    }
+
+    bool remove(Filter *filter) {
+        bool found = false;
+        update([&](std::vector<Filter*> &list) {
+            auto it = std::find(list.begin(), list.end(), filter);
+            if((found = it != list.end())) list.erase(it);
+        });
+        return found;
+    }
+
+    void clear() { update([](std::vector<Filter*> &list) { list.clear(); }); }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(mutex);
+        const std::vector<Filter*> *list = current.load();
+        return list ? list->size() : 0;
+    }
+
+    // audio thread
+    void process(float *data, size_t frames, int freq) {
+        busy.store(true);
+        if(const std::vector<Filter*> *list = current.load()) {
+            for(Filter *f : *list) f->process(data, frames, freq);
+        }
+        busy.store(false);
+    }
+
+private:
+    template<class F> void update(F edit) {
+        std::lock_guard<std::mutex> guard(mutex);
+        const std::vector<Filter*> *old = current.load();
+        std::vector<Filter*> *list = old ? new std::vector<Filter*>(*old) : new std::vector<Filter*>();
+        edit(*list);
+        if(list->empty()) {
+            delete list;
+            list = nullptr;
+        }
+        current.store(list);
+        // a block that loaded the old list has set busy before the store above
+        while(busy.load()) std::this_thread::yield();
+        delete old;
+    }
+
+    std::atomic<const std::vector<Filter*>*> current{nullptr};
+    std::atomic<bool> busy{false};
+    mutable std::mutex mutex;   // serializes edits, never taken by the audio thread
+};
+
+// filter slot of a voice, read by the mixer once per block
+struct VoiceFilter {
+    int type = AUDIOLIB_FILTER_NONE;
+    float cutoff = 1000.0f;     // Hz
+    float q = 0.7071f;
+};
+
+// biquad of one voice between blocks
+struct VoiceFilterState {
+    float coef[5] = {};         // b0 b1 b2 a1 a2 reached at the end of the last block
+    float z1[2] = {}, z2[2] = {};
+    bool active = false;
+};
+
+// b0 b1 b2 a1 a2 normalized by a0 (RBJ cookbook), a one-pole is a biquad with b1 b2 a2 zero
+inline void biquadCoefficients(const VoiceFilter &f, int freq, float *c) {
+    double w = 2.0 * 3.14159265358979323846 * std::min(std::max(double(f.cutoff), 10.0), 0.45 * freq) / freq;
+    if(f.type == AUDIOLIB_FILTER_ONEPOLE) {
+        double a = 1.0 - std::exp(-w);
+        c[0] = float(a);
+        c[1] = c[2] = c[4] = 0.0f;
+        c[3] = float(a - 1.0);
+        return;
+    }
+    double cw = std::cos(w), alpha = std::sin(w) / (2.0 * std::max(double(f.q), 0.1)), a0 = 1.0 + alpha;
+    double b[3] = { (1.0 - cw) / 2.0, 1.0 - cw, (1.0 - cw) / 2.0 };
+    if(f.type == AUDIOLIB_FILTER_HIGHPASS) {
+        b[0] = b[2] = (1.0 + cw) / 2.0;
+        b[1] = -(1.0 + cw);
+    } else if(f.type == AUDIOLIB_FILTER_BANDPASS) {
+        b[0] = alpha;
+        b[1] = 0.0;
+        b[2] = -alpha;
+    }
+    c[0] = float(b[0] / a0);
+    c[1] = float(b[1] / a0);
+    c[2] = float(b[2] / a0);
+    c[3] = float(-2.0 * cw / a0);
+    c[4] = float((1.0 - alpha) / a0);
+}
+
+// biquads of several voices side by side, one SIMD lane per voice channel, transposed direct form II.
+// Voices load their coefficients and state into the lanes for one block and store them back after it;
+// coefficients move linearly to the new settings over the block so cutoff sweeps don't click
+class FilterBank {
+public:
+#if defined(AUDIOLIB_AVX)
+    static constexpr size_t LANES = 8;
+#elif defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+    static constexpr size_t LANES = 4;
+#else
+    static constexpr size_t LANES = 2;
 #endif
+    static constexpr size_t VOICES = LANES / 2;
 
-/*
- */
+    void load(size_t voice, const VoiceFilter &settings, VoiceFilterState &state, int freq, size_t frames) {
+        float target[5];
+        biquadCoefficients(settings, freq, target);
+        if(!state.active) {
+            state = VoiceFilterState();
+            memcpy(state.coef, target, sizeof(target));
+            state.active = true;
+        }
+        for(size_t c = 0; c < 2; c++) {
+            size_t lane = voice * 2 + c;
+            for(int k = 0; k < 5; k++) {
+                coef[k][lane] = state.coef[k];
+                step[k][lane] = (target[k] - state.coef[k]) / float(frames);
+            }
+            z1[lane] = state.z1[c];
+            z2[lane] = state.z2[c];
+        }
+        memcpy(state.coef, target, sizeof(target));
+    }
 
-namespace AudioLib {
+    // lanes of a voice slot without a voice pass nothing through
+    void clear(size_t voice) {
+        for(size_t lane = voice * 2; lane < voice * 2 + 2; lane++) {
+            for(int k = 0; k < 5; k++) coef[k][lane] = step[k][lane] = 0.0f;
+            z1[lane] = z2[lane] = 0.0f;
+        }
+    }
 
-class Manager;
-constexpr size_t SAMPLE_SIZE = sizeof(int16_t) * 2;
-constexpr size_t SAMPLE_COUNT = 2048;
-constexpr size_t BUFFER_SIZE = SAMPLE_COUNT * SAMPLE_SIZE;
+    void store(size_t voice, VoiceFilterState &state) const {
+        for(size_t c = 0; c < 2; c++) {
+            state.z1[c] = z1[voice * 2 + c];
+            state.z2[c] = z2[voice * 2 + c];
+        }
+    }
 
-enum {
-    AUDIOLIB_SUCCESS = 0,
-    AUDIOLIB_FILE_ERROR,
-    AUDIOLIB_DECODE_ERROR,
-    AUDIOLIB_WRONG_SAMPLE_RATE,
-    AUDIOLIB_WRONG_CHANNEL_COUNT
+    // VOICES interleaved stereo buffers in place
+    void process(float *const *voices, size_t frames) {
+#if defined(AUDIOLIB_AVX)
+        __m256 b0 = _mm256_loadu_ps(coef[0]), b1 = _mm256_loadu_ps(coef[1]), b2 = _mm256_loadu_ps(coef[2]);
+        __m256 a1 = _mm256_loadu_ps(coef[3]), a2 = _mm256_loadu_ps(coef[4]);
+        __m256 db0 = _mm256_loadu_ps(step[0]), db1 = _mm256_loadu_ps(step[1]), db2 = _mm256_loadu_ps(step[2]);
+        __m256 da1 = _mm256_loadu_ps(step[3]), da2 = _mm256_loadu_ps(step[4]);
+        __m256 s1 = _mm256_loadu_ps(z1), s2 = _mm256_loadu_ps(z2);
+        for(size_t i = 0; i < frames; i++) {
+            __m128 lo = _mm_loadh_pi(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(voices[0] + i * 2))), reinterpret_cast<const __m64*>(voices[1] + i * 2));
+            __m128 hi = _mm_loadh_pi(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(voices[2] + i * 2))), reinterpret_cast<const __m64*>(voices[3] + i * 2));
+            __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+            __m256 y = _mm256_add_ps(_mm256_mul_ps(b0, x), s1);
+            s1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x), _mm256_mul_ps(a1, y)), s2);
+            s2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+            lo = _mm256_castps256_ps128(y);
+            hi = _mm256_extractf128_ps(y, 1);
+            _mm_storel_pi(reinterpret_cast<__m64*>(voices[0] + i * 2), lo);
+            _mm_storeh_pi(reinterpret_cast<__m64*>(voices[1] + i * 2), lo);
+            _mm_storel_pi(reinterpret_cast<__m64*>(voices[2] + i * 2), hi);
+            _mm_storeh_pi(reinterpret_cast<__m64*>(voices[3] + i * 2), hi);
+            b0 = _mm256_add_ps(b0, db0); b1 = _mm256_add_ps(b1, db1); b2 = _mm256_add_ps(b2, db2);
+            a1 = _mm256_add_ps(a1, da1); a2 = _mm256_add_ps(a2, da2);
+        }
+        _mm256_storeu_ps(z1, s1);
+        _mm256_storeu_ps(z2, s2);
+#elif defined(AUDIOLIB_SSE2)
+        __m128 b0 = _mm_loadu_ps(coef[0]), b1 = _mm_loadu_ps(coef[1]), b2 = _mm_loadu_ps(coef[2]);
+        __m128 a1 = _mm_loadu_ps(coef[3]), a2 = _mm_loadu_ps(coef[4]);
+        __m128 db0 = _mm_loadu_ps(step[0]), db1 = _mm_loadu_ps(step[1]), db2 = _mm_loadu_ps(step[2]);
+        __m128 da1 = _mm_loadu_ps(step[3]), da2 = _mm_loadu_ps(step[4]);
+        __m128 s1 = _mm_loadu_ps(z1), s2 = _mm_loadu_ps(z2);
+        for(size_t i = 0; i < frames; i++) {
+            __m128 x = _mm_loadh_pi(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(voices[0] + i * 2))), reinterpret_cast<const __m64*>(voices[1] + i * 2));
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+            s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), s2);
+            s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            _mm_storel_pi(reinterpret_cast<__m64*>(voices[0] + i * 2), y);
+            _mm_storeh_pi(reinterpret_cast<__m64*>(voices[1] + i * 2), y);
+            b0 = _mm_add_ps(b0, db0); b1 = _mm_add_ps(b1, db1); b2 = _mm_add_ps(b2, db2);
+            a1 = _mm_add_ps(a1, da1); a2 = _mm_add_ps(a2, da2);
+        }
+        _mm_storeu_ps(z1, s1);
+        _mm_storeu_ps(z2, s2);
+#elif defined(AUDIOLIB_NEON)
+        float32x4_t b0 = vld1q_f32(coef[0]), b1 = vld1q_f32(coef[1]), b2 = vld1q_f32(coef[2]);
+        float32x4_t a1 = vld1q_f32(coef[3]), a2 = vld1q_f32(coef[4]);
+        float32x4_t db0 = vld1q_f32(step[0]), db1 = vld1q_f32(step[1]), db2 = vld1q_f32(step[2]);
+        float32x4_t da1 = vld1q_f32(step[3]), da2 = vld1q_f32(step[4]);
+        float32x4_t s1 = vld1q_f32(z1), s2 = vld1q_f32(z2);
+        for(size_t i = 0; i < frames; i++) {
+            float32x4_t x = vcombine_f32(vld1_f32(voices[0] + i * 2), vld1_f32(voices[1] + i * 2));
+            float32x4_t y = vmlaq_f32(s1, b0, x);
+            s1 = vaddq_f32(vmlsq_f32(vmulq_f32(b1, x), a1, y), s2);
+            s2 = vmlsq_f32(vmulq_f32(b2, x), a2, y);
+            vst1_f32(voices[0] + i * 2, vget_low_f32(y));
+            vst1_f32(voices[1] + i * 2, vget_high_f32(y));
+            b0 = vaddq_f32(b0, db0); b1 = vaddq_f32(b1, db1); b2 = vaddq_f32(b2, db2);
+            a1 = vaddq_f32(a1, da1); a2 = vaddq_f32(a2, da2);
+        }
+        vst1q_f32(z1, s1);
+        vst1q_f32(z2, s2);
+#else
+        for(size_t lane = 0; lane < LANES; lane++) {
+            float *data = voices[lane / 2] + lane % 2;
+            float c[5], s1 = z1[lane], s2 = z2[lane];
+            for(int k = 0; k < 5; k++) c[k] = coef[k][lane];
+            for(size_t j = 0; j < frames; j++) {
+                float x = data[j * 2], y = c[0] * x + s1;
+                s1 = c[1] * x - c[3] * y + s2;
+                s2 = c[2] * x - c[4] * y;
+                data[j * 2] = y;
+                for(int k = 0; k < 5; k++) c[k] += step[k][lane];
+            }
+            z1[lane] = s1;
+            z2[lane] = s2;
+        }
+#endif
+    }
+
+private:
+    float coef[5][LANES];
+    float step[5][LANES];
+    float z1[LANES], z2[LANES];
+};
+
+/************************************************************************
+ * Sound
+ ************************************************************************/
+
+// half-band decimated copies of a sound for AUDIOLIB_LOAD_PITCHED, level k at 1/2^k of its rate;
+// a voice above rate 1 reads the level where it steps at most one frame per output frame
+struct MipChain {
+    static constexpr int LEVELS = 2;    // enough for rate 4
+
+    // from the interleaved samples of a whole sound. A level of a looping sound holds whole passes: one whose
+    // length is odd is decimated over two passes, so that level keeps as many frames as the one before it
+    template<class T> void build(const T *src, size_t frames, int channels, bool loop) {
+        // 63-tap blackman windowed half-band, all even taps besides the center are zero
+        constexpr int TAPS = 16;
+        float h[TAPS];
+        double sum = 0.5;
+        for(int k = 0; k < TAPS; k++) {
+            double n = 2 * k + 1, x = 3.14159265358979323846 * n / 2.0;
+            double w = 0.42 + 0.5 * std::cos(3.14159265358979323846 * n / 31.0) + 0.08 * std::cos(2.0 * 3.14159265358979323846 * n / 31.0);
+            h[k] = float(0.5 * std::sin(x) / x * w);
+            sum += 2.0 * h[k];
+        }
+        for(auto &v : h) v = float(v / sum);
+        float center = float(0.5 / sum);
+        
+        format = std::is_integral<T>::value ? AUDIOLIB_FORMAT_PCM16 : AUDIOLIB_FORMAT_FLOAT;
+        data.clear();
+        levels = 0;
+        std::vector<float> cur(src, src + frames * channels), next;
+        for(int level = 1; level <= LEVELS && frames >= 2; level++) {
+            if(loop && frames % 2) {
+                cur.resize(frames * 2 * channels);
+                std::copy(cur.begin(), cur.begin() + frames * channels, cur.begin() + frames * channels);
+                frames *= 2;
+            }
+            ptrdiff_t n = ptrdiff_t(frames);
+            auto at = [&](ptrdiff_t i, int c) -> float {
+                if(loop) i = (i % n + n) % n;
+                else if(i < 0 || i >= n) return 0.0f;
+                return cur[i * channels + c];
+            };
+            size_t out = (frames + 1) / 2;
+            next.resize(out * channels);
+            for(size_t j = 0; j < out; j++) {
+                ptrdiff_t i = ptrdiff_t(j) * 2;
+                bool inside = i >= 2 * TAPS && i + 2 * TAPS < n;
+                for(int c = 0; c < channels; c++) {
+                    float acc = center * cur[i * channels + c];
+                    for(int k = 0; k < TAPS; k++) {
+                        ptrdiff_t d = 2 * k + 1;
+                        acc += h[k] * (inside ? cur[(i - d) * channels + c] + cur[(i + d) * channels + c] : at(i - d, c) + at(i + d, c));
+                    }
+                    next[j * channels + c] = acc;
+                }
+            }
+            
+            offset[level] = data.size();
+            length[level] = out * channels;
+            data.resize(data.size() + length[level] * sizeof(T));
+            T *dst = reinterpret_cast<T*>(data.data() + offset[level]);
+            for(size_t i = 0; i < length[level]; i++) {
+                float v = next[i];
+                if(std::is_integral<T>::value) dst[i] = T(std::lrintf(std::min(std::max(v, -32768.0f), 32767.0f)));
+                else dst[i] = T(v);
+            }
+            levels = level;
+            cur.swap(next);
+            frames = out;
+        }
+    }
+
+    const uint8_t *samples(int level) const { return data.data() + offset[level]; }
+    size_t getSampleSize() const { return format == AUDIOLIB_FORMAT_FLOAT ? sizeof(float) : sizeof(int16_t); }
+
+    std::vector<uint8_t> data;      // the levels one after another
+    size_t offset[LEVELS + 1] = {};
+    size_t length[LEVELS + 1] = {}; // samples in each level
+    int format = AUDIOLIB_FORMAT_PCM16;
+    int levels = 0;
 };
 
 struct Sound {
     friend class Manager;
+    friend class BankBuilder;
+    friend class ConvolutionReverb;
     
     Sound() { }
-    virtual ~Sound() { delete [] data; }
+    virtual ~Sound() {
+        freeData();
+        if(Pending *p = pending.load()) {
+            delete [] p->data;
+            delete p;
+        }
+    }
 
     virtual int32_t load(const std::string &filename, int32_t _loop) = 0;
-    virtual void read(size_t samples) { }
     
-    void play() { is_playing = true; }
+    // sound from any byte source, filename is only its name
+    virtual int32_t loadFrom(std::unique_ptr<Reader>, int32_t) { return AUDIOLIB_FILE_ERROR; }
+    
+    // samples stored in a bank as they are kept in memory, played in place
+    virtual int32_t loadEntry(const Bank &bank, const BankEntry &entry, int32_t _loop) {
+        if(entry.type != AUDIOLIB_BANK_SAMPLES) return AUDIOLIB_DECODE_ERROR;
+        this->filename = bank.getName(entry);
+        this->loop = _loop;
+        useSamples(bank.getFile(), bank.getData(entry), entry.info);
+        return AUDIOLIB_SUCCESS;
+    }
+    
+    // keeps the samples from the play position on in data, false while a streaming sound doesn't have them yet
+    virtual bool read(size_t) { return true; }
+    virtual void buildSeekIndex() { }
+    // decodes ahead of playback on the stream thread
+    virtual void refill() { }
+    
+    // starting or stopping drops the filter slot state, so a restarted voice doesn't ring with the last note's
+    void play() {
+        if(!is_playing) filter_state.active = false;
+        is_playing = true;
+    }
     void pause() { is_playing = false; }
     void stop() {
         is_playing = false;
-        pos_sample = 0;
-        delete [] data;
-        data = nullptr;
+        pos = 0;
+        step = 0;
+        filter_state.active = false;
+        // a conversion on the decode pool may still be reading the samples, a streaming sound's
+        // jobs only scan its file but the stream thread writes into its ring
+        if(!streaming) waitJobs();
+        if(streamer) streamer->remove(this);
+        freeData();
     }
-    void seek(float t_sec) { pos_sample = t_sec * freq * channels; }
+    void seek(float t_sec) { pos = uint64_t(std::max(t_sec * freq, 0.0f)) << 32; }
 
-    float getPositionSec() const { return (pos_sample / channels) / float(freq); }
+    float getPositionSec() const { return float(double(pos) / 4294967296.0 / freq); }
     float getDuration() const { return duration_sec; }
     bool isPlaying() const { return is_playing; }
+    bool isResampled() const { return resampled; }
+    bool isStreaming() const { return streaming; }
+    // blocks played silent because a streaming sound's samples weren't decoded yet
+    uint32_t getUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+    bool isMapped() const { return mapping != nullptr; }
+    int getFormat() const { return format; }
     std::string getFilePath() const { return filename; }
+    size_t getMemorySize() const { return data ? size : 0; }
+    size_t getMipSize() const { return mips.data.size(); }
+    virtual size_t getCompressedSize() const { return 0; }
     
     float volume = 1.0f;
     float pan = 0.0f;
+    VoiceFilter filter;         // runs first, in the mixer's filter bank
+    FilterChain filters;        // runs on the voice at its source rate, before volume and pan
+    float sends[MAX_SENDS] = {};    // levels into the buses from Manager::addBus, after volume and pan
+    float rate = 1.0f;          // playback speed and pitch, 0.25 to 4; a change ramps across the next block
+    int interpolation = AUDIOLIB_INTERP_CUBIC;
     
 protected:
-    void fillBuffer(void *buf, void *prev_buf, void *temp_buf, size_t samples) {
-        if(!is_playing || !data) return;
+    // whole file when the sound keeps it or AUDIOLIB_LOAD_MMAP asks for a mapping, otherwise read through the read-ahead
+    std::unique_ptr<Reader> openReader(const std::string &path, bool keep) const {
+        if(keep || (flags & AUDIOLIB_LOAD_MMAP)) return openMapped(path, (flags & AUDIOLIB_LOAD_MMAP) != 0);
+        return openFile(path);
+    }
 
-        int16_t *dst = static_cast<int16_t*>(temp_buf);
-        const int16_t *src = reinterpret_cast<const int16_t*>(data);
-        size_t src_samples = this->size / sizeof(int16_t);
-        size_t src_samples_repeats = src_samples * (loop+1);
-        int32_t sample_scale = 44100 / freq;
-        
-        samples /= sample_scale;
+    // background work on the decode pool that reads the sound, waited for before its samples are freed
+    void beginJob() { jobs++; }
+    void endJob() {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        if(--jobs == 0) job_cv.notify_all();
+    }
+    void waitJobs() {
+        std::unique_lock<std::mutex> lock(job_mutex);
+        job_cv.wait(lock, [this] { return jobs == 0; });
+    }
+
+    // sample data converted off the audio thread
+    struct Pending {
+        uint8_t *data;
+        size_t size, length;
+        int freq, format;
+        uint32_t block_align;
+        MipChain mips;
+    };
 
-        if(loop >= 0) memset(temp_buf, 0, BUFFER_SIZE);
-        read(samples);
+    bool needsConversion() const {
+        if(!data || streaming || format == AUDIOLIB_FORMAT_ADPCM) return false;
+        return ((flags & AUDIOLIB_LOAD_RESAMPLE) && freq != OUTPUT_FREQ) || (flags & AUDIOLIB_LOAD_ADPCM) || ((flags & AUDIOLIB_LOAD_PITCHED) && !mips.levels);
+    }
+
+    // load time conversions selected by flags,
+    // async results are picked up by the audio thread on the next mix
+    void convert(bool async) {
+        if(!needsConversion()) return;
+        bool resample = (flags & AUDIOLIB_LOAD_RESAMPLE) && freq != OUTPUT_FREQ;
         
+        Pending *p = new Pending { nullptr, size, length, freq, format, block_align, MipChain() };
+        if(resample) {
+            if(format == AUDIOLIB_FORMAT_FLOAT) p->data = this->resample<float>(p->size);
+            else p->data = this->resample<int16_t>(p->size);
+            p->length = p->size / getSampleSize();
+            p->freq = OUTPUT_FREQ;
+        }
+        if(flags & AUDIOLIB_LOAD_PITCHED) {
+            const uint8_t *src = p->data ? p->data : data;
+            if(format == AUDIOLIB_FORMAT_FLOAT) p->mips.build(reinterpret_cast<const float*>(src), p->length / channels, channels, loop != 0);
+            else p->mips.build(reinterpret_cast<const int16_t*>(src), p->length / channels, channels, loop != 0);
+        }
+        if(flags & AUDIOLIB_LOAD_ADPCM) {
+            const uint8_t *src = p->data ? p->data : data;
+            std::vector<int16_t> pcm;
+            if(format == AUDIOLIB_FORMAT_FLOAT) {
+                pcm.resize(p->length);
+                convertF32(reinterpret_cast<const float*>(src), pcm.data(), p->length);
+                src = reinterpret_cast<const uint8_t*>(pcm.data());
+            }
+            p->block_align = 512 * channels;
+            uint8_t *adpcm = adpcmEncodeBlocks(reinterpret_cast<const int16_t*>(src), p->length / channels, channels, p->block_align, p->size);
+            delete [] p->data;
+            p->data = adpcm;
+            p->format = AUDIOLIB_FORMAT_ADPCM;
+            adpcm_cache.resize(adpcmBlockFrames(p->block_align, channels) * channels);
+        }
+        // samples mapped from the cache are already in it
+        if(!cache_path.empty() && p->data) writeCache(*p);
+        else if(!cache_path.empty() && !mapping) writeCache();
+        pending = p;
+        if(!async) applyPending();
+    }
+
+    // converts data to OUTPUT_FREQ with the taps and RESAMPLE_DELAY SubBus::resample uses, so a
+    // resampled sound plays sample for sample like the native one. One shot sounds gain the two frame
+    // tail the sub-bus rings out; loops wrap, and differ from the sub-bus only on the first two source
+    // frames of the first pass, where the sub-bus still holds silence
+    template<class T> uint8_t *resample(size_t &out_size) const {
+        const T *src = reinterpret_cast<const T*>(data);
+        size_t frames = length / channels;
+        size_t out_frames = loop != 0 ? frames : frames + RESAMPLE_DELAY;
+        int32_t scale = OUTPUT_FREQ / freq;
+        out_size = out_frames * scale * channels * sizeof(T);
+        uint8_t *out = new uint8_t[out_size];
+        T *dst = reinterpret_cast<T*>(out);
+        auto at = [&](size_t i, size_t offset, int c) -> float {
+            ptrdiff_t j = ptrdiff_t(i + offset) - ptrdiff_t(RESAMPLE_DELAY) - 1;
+            if(loop != 0) j = (j + 2 * ptrdiff_t(frames)) % ptrdiff_t(frames);
+            else if(j < 0 || j >= ptrdiff_t(frames)) return 0.0f;
+            return src[j * channels + c];
+        };
+        for(size_t i = 0; i < out_frames; i++) {
+            for(int c = 0; c < channels; c++) {
+                float w[] = { at(i, 0, c), at(i, 1, c), at(i, 2, c), at(i, 3, c) };
+                for(int32_t j = 0; j < scale; j++) {
+                    float v = hermite(w, float(j) / scale);
+                    if(std::is_integral<T>::value) v = std::min(std::max(v, -32768.0f), 32767.0f);
+                    dst[(i * scale + j) * channels + c] = T(v);
+                }
+            }
+        }
+        return out;
+    }
+
+    void applyPending() {
+        Pending *p = pending.exchange(nullptr);
+        if(!p) return;
+        mips = std::move(p->mips);
+        if(p->data) {
+            pos *= uint64_t(p->freq / freq);
+            resampled |= p->freq != freq;
+            freeData();
+            data = p->data;
+            size = p->size;
+            length = p->length;
+            freq = p->freq;
+            format = p->format;
+            block_align = p->block_align;
+            adpcm_block = SIZE_MAX;
+        }
+        delete p;
+    }
+
+    size_t getSampleSize() const { return format == AUDIOLIB_FORMAT_FLOAT ? sizeof(float) : sizeof(int16_t); }
+
+    void freeData() {
+        if(mapping) mapping.reset();
+        else delete [] data;
+        data = nullptr;
+    }
+
+    SampleInfo getSampleInfo(const Pending &p) const {
+        return SampleInfo { p.size, p.length, p.format, channels, p.freq, bps, p.block_align, uint32_t(resampled || p.freq != freq), duration_sec, 0 };
+    }
+
+    // plays samples in place from a mapped cache entry or bank, the mapping stays alive as long as they are used
+    void useSamples(const std::shared_ptr<MappedFile> &owner, const uint8_t *samples, const SampleInfo &info) {
+        freeData();
+        this->mapping = owner;
+        this->data = const_cast<uint8_t*>(samples);
+        this->size = size_t(info.size);
+        this->length = size_t(info.length);
+        this->format = info.format;
+        this->channels = info.channels;
+        this->freq = info.freq;
+        this->bps = info.bps;
+        this->block_align = info.block_align;
+        this->resampled = info.resampled != 0;
+        this->duration_sec = info.duration_sec;
+        if(format == AUDIOLIB_FORMAT_ADPCM) adpcm_cache.resize(adpcmBlockFrames(block_align, channels) * channels);
+    }
+
+    // decoded sample data on disk, the header is followed by the samples as they are kept in memory
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        SampleInfo info;
+    };
+    static_assert(sizeof(CacheHeader) == 64, "samples stay aligned after the header");
+    static constexpr uint32_t CACHE_MAGIC = 0x4D43504C;  // LPCM
+    static constexpr uint32_t CACHE_VERSION = 1;
+
+    // maps the cached samples instead of decoding the file
+    bool readCache(const std::string &_filename, int32_t _loop) {
+        auto file = std::make_shared<MappedFile>();
+        if(!file->open(cache_path, true) || file->size < sizeof(CacheHeader)) return false;
+        CacheHeader header;
+        memcpy(&header, file->data, sizeof(header));
+        if(header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != cache_key || !checkSampleInfo(header.info, file->size - sizeof(header))) return false;
+        this->filename = _filename;
+        this->loop = _loop;
+        useSamples(file, file->data + sizeof(header), header.info);
+        return true;
+    }
+
+    // written to a temporary file first so that a reader never maps a partial one
+    void writeCache(const Pending &p) const {
+        CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, cache_key, getSampleInfo(p) };
+        std::string temp_path = cache_path + ".tmp";
+        FILE *out = fopen(temp_path.c_str(), "wb");
+        if(!out) return;
+        bool ok = fwrite(&header,sizeof(header),1,out) && fwrite(p.data,p.size,1,out);
+        ok = fclose(out) == 0 && ok;
+        if(!ok || rename(temp_path.c_str(), cache_path.c_str()) != 0) remove(temp_path.c_str());
+    }
+
+    void writeCache() const {
+        writeCache(Pending { data, size, length, freq, format, block_align, MipChain() });
+    }
+
+    // contiguous run of at most count samples starting at sample index of a mip level
+    const void *fetch(size_t index, size_t count, size_t &n, int level = 0) {
+        if(level) {
+            index %= mips.length[level];
+            n = std::min(count, mips.length[level] - index);
+            return mips.samples(level) + index * mips.getSampleSize();
+        }
+        if(format == AUDIOLIB_FORMAT_ADPCM) {
+            size_t block_frames = adpcmBlockFrames(block_align, channels);
+            size_t frame = index % length / channels;
+            size_t block = frame / block_frames;
+            size_t frames = std::min(block_frames, length / channels - block * block_frames);
+            if(block != adpcm_block) {
+                adpcmDecodeBlock(data + block * block_align, channels, frames, adpcm_cache.data());
+                adpcm_block = block;
+            }
+            size_t offset = (frame - block * block_frames) * channels;
+            n = std::min(count, frames * channels - offset);
+            return adpcm_cache.data() + offset;
+        }
+        size_t src_samples = this->size / getSampleSize();
+        index %= src_samples;
+        n = std::min(count, src_samples - index);
+        return data + index * getSampleSize();
+    }
+
+    // n source samples to stereo float
+    template<class T> void expand(float *dst, const T *src, size_t n, float scale) const {
         // stereo
         if(channels == 2) {
-            if(loop < 0) {
-                for(int j = 0; j < samples * 2; j++) {
-                    dst[j] = src[(pos_sample + j) % src_samples];
-                }
-            } else if(pos_sample < src_samples_repeats) {
-                for(int j = 0; j < std::min(samples * 2, src_samples_repeats - pos_sample); j++) {
-                    dst[j] = src[(pos_sample + j) % src_samples];
-                }
+            for(size_t k = 0; k < n; k++) {
+                dst[k] = src[k] * scale;
             }
             
         // mono
         } else {
-            if(loop < 0) {
-                for(int j = 0; j < samples; j++) {
-                    dst[j*2] = dst[j*2+1] = src[(pos_sample + j) % src_samples];
-                }
-            } else if(pos_sample < src_samples_repeats) {
-                for(int j = 0; j < std::min(samples, src_samples_repeats - pos_sample); j++) {
-                    dst[j*2] = dst[j*2+1] = src[(pos_sample + j) % src_samples];
-                }
+            for(size_t k = 0; k < n; k++) {
+                dst[k * 2] = dst[k * 2 + 1] = src[k] * scale;
+            }
+        }
+    }
+
+    // source frames of a mip level from start on as stereo float, silence past the end
+    void gather(float *dst, size_t start, size_t frames, int level = 0) {
+        // a mip frame stands for the source frame at its index shifted up by the level, a level may hold two passes
+        size_t src_samples_repeats = level ? ((length / channels * (loop+1) + (size_t(1) << level) - 1) >> level) * channels : length * (loop+1);
+        bool is_float = (level ? mips.format : format) == AUDIOLIB_FORMAT_FLOAT;
+        constexpr float scale = 1.0f / 32768.0f;
+
+        size_t index = start * channels;
+        size_t count = frames * channels;
+        if(loop >= 0) count = index < src_samples_repeats ? std::min(count, src_samples_repeats - index) : 0;
+
+        for(size_t j = 0, n = 0; j < count; j += n) {
+            const void *src = fetch(index + j, count - j, n, level);
+            float *out = dst + j * 2 / channels;
+            if(is_float) expand(out, static_cast<const float*>(src), n, 1.0f);
+            else expand(out, static_cast<const int16_t*>(src), n, scale);
+        }
+        std::fill(dst + count * 2 / channels, dst + frames * 2, 0.0f);
+    }
+
+    // reads frames at the source rate times the voice rate into dst as stereo float,
+    // data holds the whole sound or a ring that read() keeps ahead of the play position
+    void render(float *dst, size_t frames) {
+        uint64_t target = uint64_t(double(std::min(std::max(rate, 0.25f), 4.0f)) * 4294967296.0);
+        if(!step) step = target;
+        
+        // plain copy at rate 1 on a whole frame
+        if(step == target && target == (1ull << 32) && !(pos & 0xffffffff)) {
+            if(!read(frames)) {
+                underrun(dst, frames);
+                return;
             }
+            gather(dst, size_t(pos >> 32), frames);
+            pos += uint64_t(frames) << 32;
+            return;
         }
-        pos_sample += samples * channels;
-//        pos_sample %= this->size / sizeof(int16_t);
         
-        // resample
-        size_t i = samples * 2 - 1;
-        int32 num = int32(samples * sample_scale * 2);
+        // the mip level where the block steps at most a frame at a time, positions are in its frames meanwhile
+        int level = 0;
+        while(level < mips.levels && (std::max(step, target) >> level) > (1ull << 32)) level++;
+        pos >>= level;
+        step >>= level;
         
-        // 22050 to 44100
-        if(sample_scale == 2) {
-            for(int32 j = num - 1; j > sample_scale * 2; j -= sample_scale * 2) {
-                const int16_t w[] = { dst[i-3], dst[i-2], dst[i-1], dst[i] };
-                dst[j-3] = (w[2] + w[0]) / 2;
-                dst[j-2] = (w[3] + w[1]) / 2;
-                dst[j-1] = w[2];
-                dst[j  ] = w[3];
-                i -= 2;
+        // interpolated from windows of source frames, window[0] is the frame before the play position
+        int64_t ramp = (int64_t(target >> level) - int64_t(step)) / int64_t(frames);
+        float window[(WINDOW + 3) * 2];
+        for(size_t i = 0; i < frames;) {
+            size_t first = size_t(pos >> 32);
+            size_t count = std::min(size_t(WINDOW), size_t((pos + std::max(step, target >> level) * (frames - i)) >> 32) - first + 1);
+            if(!level && !read(count + 2)) {
+                underrun(dst + i * 2, frames - i);
+                break;
             }
-            if(prev_buf) {
-                const int16_t *prev_dst = static_cast<const int16_t*>(prev_buf);
-                const int16_t w[] = { prev_dst[num-2], prev_dst[num-1], dst[0], dst[1] };
-                dst[0] = (w[2] + w[0]) / 2;
-                dst[1] = (w[3] + w[1]) / 2;
-                dst[2] = w[2];
-                dst[3] = w[3];
+            if(first) {
+                gather(window, first - 1, count + 3, level);
+            } else {
+                window[0] = window[1] = 0.0f;
+                gather(window + 2, 0, count + 2, level);
             }
+            i += interpolate(dst + i * 2, window, first, first + count, frames - i, ramp);
+        }
+        pos <<= level;
+        step = target;
+    }
+
+    // silence while the samples aren't there, the play position waits for them
+    void underrun(float *dst, size_t frames) {
+        std::fill(dst, dst + frames * 2, 0.0f);
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // up to n frames whose taps lie in the window, which holds source frames from first - 1 until limit + 2;
+    // returns how many
+    size_t interpolate(float *dst, const float *window, size_t first, size_t limit, size_t n, int64_t ramp) {
+        bool cubic = interpolation == AUDIOLIB_INTERP_CUBIC;
+        size_t i = 0;
+#if defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+        // two frames per step, both channels of a frame in neighbouring lanes
+        typedef simd::Vec4 V;
+        for(; i + 2 <= n; i += 2) {
+            uint64_t next = pos + step;
+            if((next >> 32) >= limit) break;
+            const float *a = window + ((pos >> 32) - first) * 2;
+            const float *b = window + ((next >> 32) - first) * 2;
+            V::type t = V::pairs(float(uint32_t(pos)) * (1.0f / 4294967296.0f), float(uint32_t(next)) * (1.0f / 4294967296.0f));
+            pos = next + step + ramp;
+            step += ramp * 2;
             
-        // 11025 to 44100
-        } else if(sample_scale == 4) {
-            for(int32 j = num - 1; j > sample_scale * 2; j -= sample_scale * 2) {
-                const int16_t w[] = { dst[i-3], dst[i-2], dst[i-1], dst[i] };
-                dst[j-7] = (w[2] + w[0]*3) / 4;
-                dst[j-6] = (w[3] + w[1]*3) / 4;
-                dst[j-5] = (w[2] + w[0]) / 2;
-                dst[j-4] = (w[3] + w[1]) / 2;
-                dst[j-3] = (w[2]*3 + w[0]) / 4;
-                dst[j-2] = (w[3]*3 + w[1]) / 4;
-                dst[j-1] = w[2];
-                dst[j  ] = w[3];
-                i -= 2;
-            }
-            if(prev_buf) {
-                const int16_t *prev_dst = static_cast<const int16_t*>(prev_buf);
-                const int16_t w[] = { prev_dst[num-2], prev_dst[num-1], dst[0], dst[1] };
-                dst[0] = (w[2] + w[0]*3) / 4;
-                dst[1] = (w[3] + w[1]*3) / 4;
-                dst[2] = (w[2] + w[0]) / 2;
-                dst[3] = (w[3] + w[1]) / 2;
-                dst[4] = (w[2]*3 + w[0]) / 4;
-                dst[5] = (w[3]*3 + w[1]) / 4;
-                dst[6] = w[2];
-                dst[7] = w[3];
-            }
-        }
-        
-        // mix
+            V::type w1 = V::frames(a + 2, b + 2), w2 = V::frames(a + 4, b + 4), out;
+            if(cubic) {
+                // hermite() on four lanes
+                V::type w0 = V::frames(a, b), w3 = V::frames(a + 6, b + 6);
+                V::type c3 = V::sub(V::add(V::mul(V::set1(3.0f), V::sub(w1, w2)), w3), w0);
+                V::type c2 = V::sub(V::add(V::sub(V::mul(V::set1(2.0f), w0), V::mul(V::set1(5.0f), w1)), V::mul(V::set1(4.0f), w2)), w3);
+                V::type c = V::add(V::sub(w2, w0), V::mul(t, V::add(c2, V::mul(t, c3))));
+                out = V::add(w1, V::mul(V::mul(V::set1(0.5f), t), c));
+            } else {
+                out = V::add(w1, V::mul(V::sub(w2, w1), t));
+            }
+            V::store(dst + i * 2, out);
+        }
+#endif
+        for(; i < n && (pos >> 32) < limit; i++) {
+            const float *w = window + ((pos >> 32) - first) * 2;
+            float t = float(uint32_t(pos)) * (1.0f / 4294967296.0f);
+            const float l[] = { w[0], w[2], w[4], w[6] };
+            const float r[] = { w[1], w[3], w[5], w[7] };
+            dst[i*2  ] = cubic ? hermite(l, t) : l[1] + (l[2] - l[1]) * t;
+            dst[i*2+1] = cubic ? hermite(r, t) : r[1] + (r[2] - r[1]) * t;
+            pos += step;
+            step += ramp;
+        }
+        return i;
+    }
+
+    // mixes frames at the source rate into stereo float buses, targets[0] is the dry bus and
+    // targets[1 + k] send bus k; returns a bit per target written
+    uint32_t mix(float *const *targets, float *temp, size_t frames) {
+        if(!is_playing || !data) return 0;
+
+        render(temp, frames);
+        return addTo(targets, temp, frames);
+    }
+
+    // a rendered block through the filter chain, volume and pan into the targets
+    uint32_t addTo(float *const *targets, float *voice, size_t frames) {
+        filters.process(voice, frames, freq);
+
         float volumes[2] = { std::min(-pan + 1.0f, 1.0f) * volume, std::min(pan + 1.0f, 1.0f) * volume };
-        int16_t *outbuf = static_cast<int16_t*>(buf);
-        for(i = 0; i < num; i++) {
-            int32_t v = outbuf[i] + dst[i] * volumes[i % 2];
-            outbuf[i] = std::min(std::max(v, -32768), 32767);
+        float *bus = targets[0];
+        for(size_t i = 0; i < frames * 2; i++) {
+            bus[i] += voice[i] * volumes[i % 2];
+        }
+        
+        uint32_t written = 1;
+        for(size_t k = 0; k < MAX_SENDS; k++) {
+            float *send = targets[k + 1];
+            if(!send || sends[k] <= 0.0f) continue;
+            float levels[2] = { volumes[0] * sends[k], volumes[1] * sends[k] };
+            for(size_t i = 0; i < frames * 2; i++) {
+                send[i] += voice[i] * levels[i % 2];
+            }
+            written |= 2u << k;
         }
+        return written;
     }
 
+    static constexpr size_t WINDOW = 256;   // source frames interpolated per read() while the rate isn't 1
+
     uint8_t *data = nullptr;
     size_t size;
+    size_t length = 0;          // samples in one pass of the sound
+    int format = AUDIOLIB_FORMAT_PCM16;
+    uint32_t block_align = 0;
     int channels, freq, bps;
     int32_t loop = 0;
     std::string filename;
-    size_t pos_sample = 0;
+    uint64_t pos = 0;           // play position in source frames, 32.32 fixed point
+    uint64_t step = 0;          // position advance per output frame at the end of the last block
     float duration_sec = 0.0f;
     bool is_playing = false;
+    bool resampled = false;
+    bool streaming = false;
+    uint32_t flags = AUDIOLIB_LOAD_DEFAULT;
+    std::atomic<Pending*> pending{nullptr};
+    std::atomic<int32_t> jobs{0};
+    std::mutex job_mutex;
+    std::condition_variable job_cv;
+    std::vector<int16_t> adpcm_cache;
+    size_t adpcm_block = SIZE_MAX;
+    std::string cache_path;
+    uint64_t cache_key = 0;
+    std::shared_ptr<MappedFile> mapping;    // owner of data when it isn't ours
+    std::shared_ptr<IOQueue> io;            // reads AUDIOLIB_LOAD_STREAM files in the background
+    std::shared_ptr<StreamThread> streamer; // decodes AUDIOLIB_LOAD_STREAM sounds ahead of playback
+    std::atomic<uint32_t> underruns{0};
+    VoiceFilterState filter_state;
+    MipChain mips;
 };
 
 /************************************************************************
@@ -192,11 +2392,16 @@ protected:
 struct SoundWAV : Sound {
     int32_t load(const std::string &_filename, int32_t _loop) override {
         this->filename = _filename;
-        this->loop = _loop;
+        auto reader = openReader(filename, false);
+        if(!reader) return AUDIOLIB_FILE_ERROR;
+        return loadFrom(std::move(reader), _loop);
+    }
 
-        FILE *file = fopen(filename.c_str(), "rb");
-        if(!file) return AUDIOLIB_FILE_ERROR;
-        fseek(file,12,SEEK_SET);
+    int32_t loadFrom(std::unique_ptr<Reader> reader, int32_t _loop) override {
+        this->loop = _loop;
+        Reader &file = *reader;
+        auto skip = [&file](size_t bytes) { return file.seek(file.tell() + bytes); };
+        if(!file.seek(12)) return AUDIOLIB_DECODE_ERROR;
 
         struct WaveFormat{
             uint16_t format;
@@ -205,74 +2410,436 @@ struct SoundWAV : Sound {
             uint32_t byte_rate;
             uint16_t block_align;
             uint16_t bps;
-        } fmt;
+            uint16_t extra_size;
+            uint16_t valid_bps;
+            uint32_t channel_mask;
+            uint16_t sub_format;
+        } fmt = {};
+        uint32_t fact_frames = 0;
         
-        while(!feof(file)) {
+        while(file.tell() < file.size()) {
             uint32_t chunk_id;
             uint32_t chunk_size;
-            if(!fread(&chunk_id,4,1,file)) break;
-            if(!fread(&chunk_size,4,1,file)) break;
+            if(file.read(&chunk_id,4) != 4) break;
+            if(file.read(&chunk_size,4) != 4) break;
+            size_t padded_size = chunk_size + (chunk_size & 1);
             if(chunk_id == 0x20746D66) { // format
-                fread(&fmt,sizeof(WaveFormat),1,file);
+                if(chunk_size < 16) break;
+                size_t fmt_size = std::min<size_t>(chunk_size, sizeof(WaveFormat));
+                if(file.read(&fmt,fmt_size) != fmt_size || !skip(padded_size - fmt_size)) break;
+                if(fmt.format == 0xFFFE && chunk_size >= 26) fmt.format = fmt.sub_format; // extensible
                 this->channels = fmt.channels;
                 this->bps = fmt.bps;
                 this->freq = fmt.sample_rate;
-                if(fmt.format != 1 || fmt.bps != 16) break;
-                if(fmt.channels < 0 || fmt.channels > 2) {
-                    fclose(file);
-                    return AUDIOLIB_WRONG_CHANNEL_COUNT;
-                }
-                if(freq != 44100 && freq != 22050 && freq != 11025) {
-                    fclose(file);
-                    return AUDIOLIB_WRONG_SAMPLE_RATE;
-                }
+                if(fmt.format == 0x11 && fmt.bps == 4 && fmt.block_align > 4 * fmt.channels) {
+                    this->format = AUDIOLIB_FORMAT_ADPCM;
+                    this->block_align = fmt.block_align;
+                } else if(fmt.format == 1 && (fmt.bps == 8 || fmt.bps == 16)) {
+                    this->format = AUDIOLIB_FORMAT_PCM16;
+                    this->bps = 16;
+                } else if((fmt.format == 1 && (fmt.bps == 24 || fmt.bps == 32)) || (fmt.format == 3 && fmt.bps == 32)) {
+                    this->format = AUDIOLIB_FORMAT_FLOAT;
+                    this->bps = 32;
+                } else break;
+                if(fmt.channels < 1 || fmt.channels > 2) return AUDIOLIB_WRONG_CHANNEL_COUNT;
+                if(freq != 44100 && freq != 22050 && freq != 11025) return AUDIOLIB_WRONG_SAMPLE_RATE;
+            } else if(chunk_id == 0x74636166) { // fact
+                if(file.read(&fact_frames,4) != 4 || !skip(padded_size - 4)) break;
             } else if(chunk_id == 0x61746164) { // data
-                this->size = chunk_size;
-                this->duration_sec = float(size / sizeof(int16_t) / channels) / freq;
-                this->data = new uint8_t[chunk_size];
-                fread(data,chunk_size,1,file);
-                fclose(file);
-                return AUDIOLIB_SUCCESS;
-            } else {
-                fseek(file,chunk_size,SEEK_CUR);
+                if(!fmt.channels) break;
+                return readData(file, chunk_size, fmt.format, fmt.bps, fact_frames);
+            } else if(!skip(padded_size)) {
+                break;
             }
         }
         
-        fclose(file);
         return AUDIOLIB_DECODE_ERROR;
     }
+
+private:
+    int32_t readData(Reader &file, uint32_t chunk_size, uint16_t source_format, uint16_t source_bps, uint32_t fact_frames) {
+        if(format == AUDIOLIB_FORMAT_ADPCM) {
+            size_t block_frames = adpcmBlockFrames(block_align, channels);
+            size_t frames = chunk_size / block_align * block_frames;
+            // the fact chunk trims the padding of the last block when it fits in the data; some writers
+            // store the whole block count divided by the channel count there, which says nothing about padding
+            bool per_channel = channels > 1 && fact_frames * channels == frames;
+            if(fact_frames && fact_frames < frames && !per_channel) frames = fact_frames;
+            this->length = frames * channels;
+            this->size = chunk_size;
+            adpcm_cache.resize(block_frames * channels);
+        } else {
+            this->length = chunk_size / (source_bps / 8 * channels) * channels;
+            this->size = length * (bps / 8);
+        }
+        if(!length) return AUDIOLIB_DECODE_ERROR;
+        this->duration_sec = float(length / channels) / freq;
+        this->data = new uint8_t[size];
+        
+        // stored as is
+        if(format == AUDIOLIB_FORMAT_ADPCM || source_bps == bps) {
+            if(file.read(data,size) != size) return AUDIOLIB_DECODE_ERROR;
+            if(source_format == 1 && source_bps == 32) convertS32(reinterpret_cast<int32_t*>(data), reinterpret_cast<float*>(data), length);
+            return AUDIOLIB_SUCCESS;
+        }
+        
+        // 8 and 24 bit samples go through a temporary buffer
+        std::vector<uint8_t> temp(length * (source_bps / 8));
+        if(file.read(temp.data(),temp.size()) != temp.size()) return AUDIOLIB_DECODE_ERROR;
+        if(source_bps == 8) convertU8(temp.data(), reinterpret_cast<int16_t*>(data), length);
+        else convertS24(temp.data(), reinterpret_cast<float*>(data), length);
+        return AUDIOLIB_SUCCESS;
+    }
+};
+
+/************************************************************************
+ * Vorbis arena
+ ************************************************************************/
+
+// alloc_buffer for stb_vorbis so that opening and decoding don't touch the heap,
+// sized from the decoders opened before
+struct VorbisArena {
+    // decoder reading from reader, straight from memory when the reader has the whole stream there;
+    // one that doesn't fit is opened on the heap and grows the arenas after it
+    stb_vorbis *open(Reader &reader) {
+        auto openWith = [&](const stb_vorbis_alloc *alloc, int *err) {
+            if(reader.map()) return stb_vorbis_open_memory(reader.map(), int(reader.size()), err, alloc);
+            stb_vorbis_io io = { &reader, readIO };
+            return stb_vorbis_open_io(&io, unsigned(reader.size()), err, alloc);
+        };
+        size_t required = getRequired().load();
+        if(buffer.size() < required) buffer.resize(required);
+        
+        int err = VORBIS_outofmem;
+        stb_vorbis *ret = nullptr;
+        if(!buffer.empty()) {
+            stb_vorbis_alloc alloc = { buffer.data(), int(buffer.size()) };
+            ret = openWith(&alloc, &err);
+        }
+        if(!ret && err == VORBIS_outofmem) {
+            ret = openWith(nullptr, nullptr);
+            if(!ret) return nullptr;
+            stb_vorbis_info info = stb_vorbis_get_info(ret);
+            size_t need = info.setup_memory_required + info.temp_memory_required;
+            while(required < need && !getRequired().compare_exchange_weak(required, need)) { }
+        }
+        return ret;
+    }
+
+    size_t getSize() const { return buffer.size(); }
+
+    // for decoders that are closed before the next one opens on the same thread
+    static VorbisArena &local() {
+        static thread_local VorbisArena ret;
+        return ret;
+    }
+
+private:
+    static int readIO(void *user, unsigned int offset, unsigned char *data, int size) {
+        Reader *reader = static_cast<Reader*>(user);
+        return reader->seek(offset) ? int(reader->read(data, size_t(size))) : 0;
+    }
+
+    static std::atomic<size_t> &getRequired() {
+        static std::atomic<size_t> ret{0};
+        return ret;
+    }
+
+    std::vector<char> buffer;
 };
 
 /************************************************************************
  * OGG
  ************************************************************************/
 
+// page offsets of a stream of file_size bytes for stb_vorbis_set_seek_index, sized from a guess
+// of one page per 4 KB and scanned again when that's too few
+inline std::vector<stb_vorbis_seek_point> buildSeekPoints(stb_vorbis *v, size_t file_size) {
+    std::vector<stb_vorbis_seek_point> ret(file_size / 4096 + 16);
+    int count = stb_vorbis_build_seek_index(v, ret.data(), int(ret.size()));
+    if(size_t(count) > ret.size()) {
+        ret.resize(count);
+        stb_vorbis_build_seek_index(v, ret.data(), count);
+    }
+    ret.resize(std::max(count, 0));
+    return ret;
+}
+
 struct SoundOGG : Sound {
+    static constexpr float STREAM_AHEAD_SEC = 0.5f;    // decoded ahead of an AUDIOLIB_LOAD_STREAM sound's play position
+
+    ~SoundOGG() {
+        if(streamer) streamer->remove(this);
+        if(vorbis) stb_vorbis_close(vorbis);
+    }
+
     int32_t load(const std::string &_filename, int32_t _loop) override {
         this->filename = _filename;
+        std::unique_ptr<Reader> reader;
+#ifdef AUDIOLIB_MMAP
+        if((flags & AUDIOLIB_LOAD_STREAM) && io && !(flags & AUDIOLIB_LOAD_MMAP)) reader = openStream(filename, io);
+        else
+#endif
+        reader = openReader(filename, (flags & AUDIOLIB_LOAD_COMPRESSED) && !(flags & AUDIOLIB_LOAD_STREAM));
+        if(!reader) return AUDIOLIB_FILE_ERROR;
+        int32_t ret = loadFrom(std::move(reader), _loop);
+        if(ret == AUDIOLIB_SUCCESS && isCompressed()) loadSeekIndex(filename + ".seek");
+        return ret;
+    }
+
+    int32_t loadFrom(std::unique_ptr<Reader> reader, int32_t _loop) override {
+        this->loop = _loop;
+        this->source = std::move(reader);
+        return open();
+    }
+
+    // encoded file inside the bank mapping, the bank's seek points replace the scan
+    int32_t loadEntry(const Bank &bank, const BankEntry &entry, int32_t _loop) override {
+        if(entry.type != AUDIOLIB_BANK_OGG) return Sound::loadEntry(bank, entry, _loop);
+        this->filename = bank.getName(entry);
         this->loop = _loop;
+        this->source.reset(new MemoryReader(bank.getData(entry), size_t(entry.size), bank.getFile()));
+        if(entry.seek_count) {
+            const stb_vorbis_seek_point *points = bank.getSeekPoints(entry);
+            seek_index.assign(points, points + entry.seek_count);
+            seek_index_ready = true;
+        }
+        return open();
+    }
+
+    bool read(size_t samples) override {
+        if(!vorbis) return true;
+        size_t pos_sample = size_t(pos >> 32) * channels;
+        size_t end = pos_sample + samples * channels;
+        if(loop >= 0) end = std::min(end, length * (loop+1));
+        // the ring also holds the frame before the play position for interpolation
+        size_t from = pos_sample ? pos_sample - channels : 0;
+        if(streamer) return ready(from, end);
         
-        stb_vorbis *stream = stb_vorbis_open_filename(filename.c_str(), NULL, NULL);
-        if(!stream) return AUDIOLIB_FILE_ERROR;
+        // seek() or a restart moved the play position out of what the ring holds
+        useSeekIndex();
+        if(from < decode_start || decode_pos < pos_sample || decode_pos + channels > pos_sample + size / getSampleSize()) restart(from);
+        fill(end);
+        return true;
+    }
+
+    // stream thread: restarts where ready() asked to, then decodes until the ring is full, a piece at a time
+    // so that the audio thread can start on the first one
+    void refill() override {
+        if(!vorbis) return;
+        useSeekIndex();
+        uint32_t request = seek_request.load(std::memory_order_acquire);
+        if(request != seek_served.load(std::memory_order_relaxed)) {
+            size_t to = seek_to.load(std::memory_order_relaxed);
+            restart(to);
+            read_pos.store(to, std::memory_order_relaxed);
+            decoded.store(to, std::memory_order_relaxed);
+            seek_served.store(request, std::memory_order_release);
+        }
+        // never past what the audio thread reads, a ring length after it
+        size_t limit = read_pos.load(std::memory_order_acquire) + size / getSampleSize();
+        if(loop >= 0) limit = std::min(limit, length * (loop+1));
+        while(decode_pos < limit && seek_request.load(std::memory_order_relaxed) == request) {
+            fill(std::min(limit, decode_pos + SAMPLE_COUNT * channels));
+            decoded.store(decode_pos, std::memory_order_release);
+        }
+    }
+
+    // encoded data plus the decoder state
+    size_t getCompressedSize() const override { return (source ? source->getMemorySize() : 0) + arena.getSize(); }
+
+    // page offsets for seeking without searching the file, scanned on the decode pool after load
+    void buildSeekIndex() override {
+        if(!vorbis || seek_index_ready) return;
+        auto reader = source->clone();
+        stb_vorbis *v = reader ? VorbisArena::local().open(*reader) : nullptr;
+        if(!v) return;
+        seek_index = buildSeekPoints(v, reader->size());
+        stb_vorbis_close(v);
+        seek_index_ready.store(true, std::memory_order_release);
+    }
+
+    // writes the seek index next to the file, load() picks it up instead of scanning
+    bool saveSeekIndex() const {
+        if(!seek_index_ready) return false;
+        FILE *out = fopen((filename + ".seek").c_str(), "wb");
+        if(!out) return false;
+        SeekIndexHeader header = { SEEK_INDEX_MAGIC, uint32_t(source->size()), uint32_t(seek_index.size()) };
+        bool ret = fwrite(&header,sizeof(header),1,out) && fwrite(seek_index.data(),sizeof(stb_vorbis_seek_point),seek_index.size(),out) == seek_index.size();
+        fclose(out);
+        return ret;
+    }
+
+private:
+    struct SeekIndexHeader {
+        uint32_t magic;
+        uint32_t file_size;
+        uint32_t count;
+    };
+    static constexpr uint32_t SEEK_INDEX_MAGIC = 0x58444953; // SIDX
+
+    void loadSeekIndex(const std::string &path) {
+        FILE *in = fopen(path.c_str(), "rb");
+        if(!in) return;
+        SeekIndexHeader header;
+        if(fread(&header,sizeof(header),1,in) && header.magic == SEEK_INDEX_MAGIC && header.file_size == source->size() && header.count) {
+            seek_index.resize(header.count);
+            if(fread(seek_index.data(),sizeof(stb_vorbis_seek_point),header.count,in) == header.count) seek_index_ready = true;
+            else seek_index.clear();
+        }
+        fclose(in);
+    }
+
+    // audio thread side of refill(): true when the ring holds from until end. A play position that moved
+    // back or past what is decoded asks the stream thread to restart there, with silence until it has
+    bool ready(size_t from, size_t end) {
+        if(end <= from) return true;
+        uint32_t request = seek_request.load(std::memory_order_relaxed);
+        if(seek_served.load(std::memory_order_acquire) != request) return false;
+        size_t ahead = decoded.load(std::memory_order_acquire);
+        if(from < read_pos.load(std::memory_order_relaxed) || from > ahead) {
+            seek_to.store(from, std::memory_order_relaxed);
+            seek_request.store(request + 1, std::memory_order_release);
+            return false;
+        }
+        read_pos.store(from, std::memory_order_release);
+        return ahead >= end;
+    }
+
+    void useSeekIndex() {
+        if(!seek_index_set && seek_index_ready.load(std::memory_order_acquire)) {
+            stb_vorbis_set_seek_index(vorbis, seek_index.data(), int(seek_index.size()));
+            seek_index_set = true;
+        }
+    }
+
+    void restart(size_t from) {
+        decode_pos = decode_start = from;
+        stb_vorbis_seek(vorbis, uint32_t(from % length / channels));
+    }
+
+    // decodes into the ring until sample end
+    void fill(size_t end) {
+        size_t sample_size = getSampleSize();
+        size_t ring = size / sample_size;
+        while(decode_pos < end) {
+            size_t offset = decode_pos % length;
+            if(offset == 0 && decode_pos) stb_vorbis_seek_start(vorbis);
+            size_t count = std::min(std::min(end - decode_pos, length - offset), ring - decode_pos % ring);
+            uint8_t *p = data + decode_pos % ring * sample_size;
+            size_t got = decode(vorbis, p, count);
+            memset(p + got * sample_size, 0, (count - got) * sample_size);
+            decode_pos += count;
+        }
+    }
+
+    // decoded while playing, from memory or from disk
+    bool isCompressed() const { return (flags & (AUDIOLIB_LOAD_COMPRESSED | AUDIOLIB_LOAD_STREAM)) != 0; }
+
+    bool isParallel() const {
+        return !isCompressed() && (flags & AUDIOLIB_LOAD_PARALLEL) && std::thread::hardware_concurrency() > 1;
+    }
+
+    int32_t open() {
+        bool compressed = isCompressed();
+        stb_vorbis *stream = source ? (compressed ? arena : VorbisArena::local()).open(*source) : nullptr;
+        if(!stream) {
+            source.reset();
+            return AUDIOLIB_FILE_ERROR;
+        }
 
         auto info = stb_vorbis_get_info(stream);
         uint32_t samples = stb_vorbis_stream_length_in_samples(stream) * info.channels;
-        if(!samples) return AUDIOLIB_DECODE_ERROR;
-        if(info.channels < 0 || info.channels > 2)
-            return AUDIOLIB_WRONG_CHANNEL_COUNT;
-        if(info.sample_rate != 44100 && info.sample_rate != 22050 && info.sample_rate != 11025)
-            return AUDIOLIB_WRONG_SAMPLE_RATE;
+        int32_t ret = AUDIOLIB_SUCCESS;
+        if(!samples) ret = AUDIOLIB_DECODE_ERROR;
+        else if(info.channels < 0 || info.channels > 2) ret = AUDIOLIB_WRONG_CHANNEL_COUNT;
+        else if(info.sample_rate != 44100 && info.sample_rate != 22050 && info.sample_rate != 11025) ret = AUDIOLIB_WRONG_SAMPLE_RATE;
+        if(ret != AUDIOLIB_SUCCESS) {
+            stb_vorbis_close(stream);
+            source.reset();
+            return ret;
+        }
         
         this->channels = info.channels;
-        this->bps = 16;
+        this->format = (flags & AUDIOLIB_LOAD_FLOAT) ? AUDIOLIB_FORMAT_FLOAT : AUDIOLIB_FORMAT_PCM16;
+        this->bps = int(getSampleSize() * 8);
         this->freq = info.sample_rate;
-        this->size = samples * sizeof(int16_t);
+        this->length = samples;
         this->duration_sec = float(samples / channels) / freq;
+
+        // decode on demand into a ring of one block, or STREAM_AHEAD_SEC filled by the stream thread
+        if(compressed) {
+            this->vorbis = stream;
+            this->streaming = true;
+            size_t frames = streamer ? std::max(size_t(STREAM_AHEAD_SEC * freq), 2 * SAMPLE_COUNT) : SAMPLE_COUNT;
+            this->size = frames * channels * getSampleSize();
+            this->data = new uint8_t[this->size];
+            return AUDIOLIB_SUCCESS;
+        }
+
+        this->size = samples * getSampleSize();
         this->data = new uint8_t[this->size];
-        stb_vorbis_get_samples_short_interleaved(stream, info.channels, reinterpret_cast<short*>(data), samples);
+        if(isParallel()) decodeParallel(stream);
+        else decode(stream, data, samples);
         stb_vorbis_close(stream);
+        source.reset();
         return AUDIOLIB_SUCCESS;
     }
+
+    // interleaved samples straight from the decoder in the storage format, float skips the 16 bit round trip
+    size_t decode(stb_vorbis *stream, uint8_t *dst, size_t count) const {
+        if(format == AUDIOLIB_FORMAT_FLOAT) return stb_vorbis_get_samples_float_interleaved(stream, channels, reinterpret_cast<float*>(dst), int(count)) * size_t(channels);
+        return stb_vorbis_get_samples_short_interleaved(stream, channels, reinterpret_cast<short*>(dst), int(count)) * size_t(channels);
+    }
+
+    // splits the whole decode into segments of at least SEGMENT_SEC, each on its own thread with its own decoder,
+    // stb_vorbis_seek decodes the packet before a segment so the seam overlap-adds as in one serial decode
+    void decodeParallel(stb_vorbis *stream) {
+        size_t frames = length / channels;
+        size_t segments = std::min<size_t>(std::thread::hardware_concurrency(), frames / (SEGMENT_SEC * freq));
+        if(segments < 2) {
+            decode(stream, data, length);
+            return;
+        }
+        size_t segment_frames = frames / segments;
+        auto decodeSegment = [this, frames, segment_frames, segments](stb_vorbis *v, size_t i) {
+            size_t begin = i * segment_frames;
+            size_t count = ((i + 1 == segments ? frames : begin + segment_frames) - begin) * channels;
+            uint8_t *dst = data + begin * channels * getSampleSize();
+            size_t got = 0;
+            if(v && (begin == 0 || stb_vorbis_seek(v, uint32_t(begin)))) got = decode(v, dst, count);
+            memset(dst + got * getSampleSize(), 0, (count - got) * getSampleSize());
+        };
+        std::vector<std::thread> threads;
+        for(size_t i = 1; i < segments; i++) {
+            threads.emplace_back([&, i] {
+                auto reader = source->clone();
+                stb_vorbis *v = reader ? VorbisArena::local().open(*reader) : nullptr;
+                decodeSegment(v, i);
+                if(v) stb_vorbis_close(v);
+            });
+        }
+        decodeSegment(stream, 0);
+        for(auto &thread : threads) thread.join();
+    }
+
+    static constexpr size_t SEGMENT_SEC = 10;
+
+
+    std::unique_ptr<Reader> source;    // encoded stream while it is decoded
+    VorbisArena arena;
+    stb_vorbis *vorbis = nullptr;
+    size_t decode_pos = 0;
+    size_t decode_start = 0;    // where decoding last resumed, the ring holds nothing before it
+    // shared with the stream thread, the audio thread reads the ring from read_pos until decoded
+    std::atomic<size_t> read_pos{0};
+    std::atomic<size_t> decoded{0};
+    std::atomic<size_t> seek_to{0};
+    std::atomic<uint32_t> seek_request{0};
+    std::atomic<uint32_t> seek_served{0};
+    std::vector<stb_vorbis_seek_point> seek_index;
+    std::atomic<bool> seek_index_ready{false};
+    bool seek_index_set = false;
 };
 
 /************************************************************************
@@ -280,17 +2847,18 @@ struct SoundOGG : Sound {
  ************************************************************************/
 
 struct SoundNoise : Sound {
-    int32_t load(const std::string &_filename, int32_t _loop) override {
+    int32_t load(const std::string &, int32_t) override {
         this->loop = -1;
         this->channels = 1;
         this->bps = 16;
         this->freq = 44100;
         this->size = SAMPLE_COUNT * sizeof(int16_t);
+        this->length = SAMPLE_COUNT;
         this->data = new uint8_t[this->size];
         return AUDIOLIB_SUCCESS;
     }
 
-    void read(size_t samples) override {
+    bool read(size_t samples) override {
         std::random_device rd;
         std::mt19937 gen(rd());
         std::uniform_int_distribution<> distrib(
@@ -299,35 +2867,347 @@ struct SoundNoise : Sound {
         );
         int16_t *dst = reinterpret_cast<int16_t*>(data);
         for(size_t i = 0; i < samples * channels; i++) dst[i] = distrib(gen);
+        return true;
     }
 };
 
 struct SoundSin : Sound {
-    int32_t load(const std::string &_filename, int32_t _loop) override {
+    int32_t load(const std::string &, int32_t) override {
         this->loop = -1;
         this->channels = 1;
         this->bps = 16;
         this->freq = 44100;
         this->size = SAMPLE_COUNT * sizeof(int16_t);
+        this->length = SAMPLE_COUNT;
         this->data = new uint8_t[this->size];
         return AUDIOLIB_SUCCESS;
     }
 
-    void read(size_t samples) override {
+    bool read(size_t samples) override {
         int16_t *dst = reinterpret_cast<int16_t*>(data);
         for(size_t i = 0; i < samples * channels; i++) {
-            size_t pos = pos_sample + i;
-            dst[pos % SAMPLE_COUNT] = std::sin((pos+std::sin(pos*0.0001f)*1000)*0.05f) * 32767;
+            size_t sample = size_t(this->pos >> 32) * channels + i;
+            dst[sample % SAMPLE_COUNT] = std::sin((sample+std::sin(sample*0.0001f)*1000)*0.05f) * 32767;
         }
+        return true;
     }
 };
 
 /************************************************************************
- * Filters
+ * Convolution reverb
  ************************************************************************/
 
-struct Filter {
-    virtual int16_t *process(int16_t *data, size_t samples) = 0;
+// uniformly partitioned overlap-save convolution with an impulse response, for one shared effect bus;
+// output is delayed by one block. Each channel keeps only the non-redundant half of its spectrum, so
+// mono and stereo responses share one contiguous multiply-add per partition
+class ConvolutionReverb : public Filter {
+public:
+    explicit ConvolutionReverb(size_t _block = 256) {
+        block = FFT::MIN_SIZE / 2;
+        while(block < _block && block < FFT::MAX_SIZE / 2) block <<= 1;
+        fft = FFT::get(block * 2);
+        for(auto *v : { &input_l, &input_r, &time }) v->assign(block * 2, 0.0f);
+        for(auto *v : { &acc_re, &acc_im }) v->assign((block + 1) * 2, 0.0f);
+        output.assign(block * 2, 0.0f);
+    }
+
+    // mono or stereo WAV at any supported rate, brought to OUTPUT_FREQ
+    bool load(const std::string &filename) {
+        SoundWAV wav;
+        if(wav.load(filename, 0) != AUDIOLIB_SUCCESS || wav.format == AUDIOLIB_FORMAT_ADPCM) return false;
+        size_t frames = wav.length / wav.channels;
+        std::vector<float> ir(wav.length);
+        if(wav.format == AUDIOLIB_FORMAT_FLOAT) memcpy(ir.data(), wav.data, wav.length * sizeof(float));
+        else for(size_t i = 0; i < wav.length; i++) ir[i] = reinterpret_cast<const int16_t*>(wav.data)[i] / 32768.0f;
+        
+        // upsampled like RESAMPLE loads, keeping the energy per second
+        int32_t scale = OUTPUT_FREQ / wav.freq;
+        if(scale > 1) {
+            std::vector<float> up(frames * scale * wav.channels);
+            auto at = [&](size_t i, int c) { return i < frames ? ir[i * wav.channels + c] : 0.0f; };
+            for(size_t i = 0; i < frames; i++) {
+                for(int c = 0; c < wav.channels; c++) {
+                    float w[] = { i ? at(i-1, c) : 0.0f, at(i, c), at(i+1, c), at(i+2, c) };
+                    for(int32_t j = 0; j < scale; j++) up[(i * scale + j) * wav.channels + c] = hermite(w, float(j) / scale) / scale;
+                }
+            }
+            ir.swap(up);
+            frames *= scale;
+        }
+        setImpulse(ir.data(), frames, wav.channels);
+        return true;
+    }
+
+    // interleaved impulse response at OUTPUT_FREQ; a stereo one filters each channel with its own response
+    void setImpulse(const float *ir, size_t frames, int channels) {
+        size_t bins = block + 1;
+        partitions = std::max<size_t>((frames + block - 1) / block, 1);
+        for(auto *v : { &fdl_re, &fdl_im, &h_re, &h_im }) v->assign(partitions * bins * 2, 0.0f);
+        
+        // scaled so that the inverse transform needs no scaling
+        const float norm = 1.0f / float(block * 2);
+        for(size_t p = 0; p < partitions; p++) {
+            for(int c = 0; c < 2; c++) {
+                float *re = &h_re[(p * 2 + c) * bins], *im = &h_im[(p * 2 + c) * bins];
+                if(c && channels == 1) {
+                    memcpy(re, re - bins, bins * sizeof(float));
+                    memcpy(im, im - bins, bins * sizeof(float));
+                    continue;
+                }
+                std::fill(time.begin(), time.end(), 0.0f);
+                for(size_t i = 0; i < block && p * block + i < frames; i++) time[i] = ir[(p * block + i) * channels + c] * norm;
+                fft->forwardReal(time.data(), re, im);
+            }
+        }
+        reset();
+    }
+
+    void reset() {
+        for(auto *v : { &input_l, &input_r, &fdl_re, &fdl_im, &output }) std::fill(v->begin(), v->end(), 0.0f);
+        fill = 0;
+        current = 0;
+    }
+
+    // the response is at OUTPUT_FREQ, on a bus at any other rate (a voice filter chain of a
+    // low-rate sound) data passes through unchanged
+    void process(float *data, size_t frames, int freq) override {
+        if(!partitions || freq != OUTPUT_FREQ) return;
+        while(frames) {
+            size_t count = std::min(frames, block - fill);
+            for(size_t i = 0; i < count; i++) {
+                float l = data[i * 2], r = data[i * 2 + 1];
+                input_l[block + fill + i] = l;
+                input_r[block + fill + i] = r;
+                data[i * 2] = dry * l + wet * output[(fill + i) * 2];
+                data[i * 2 + 1] = dry * r + wet * output[(fill + i) * 2 + 1];
+            }
+            fill += count;
+            data += count * 2;
+            frames -= count;
+            if(fill == block) processBlock();
+        }
+    }
+
+    size_t getLatency() const { return block; }
+
+    float wet = 0.3f;
+    float dry = 1.0f;
+
+private:
+    void processBlock() {
+        size_t bins = block + 1;
+        float *re = &fdl_re[current * bins * 2], *im = &fdl_im[current * bins * 2];
+        fft->forwardReal(input_l.data(), re, im);
+        fft->forwardReal(input_r.data(), re + bins, im + bins);
+        
+        // newest input with the first partition, the one before with the second...
+        std::fill(acc_re.begin(), acc_re.end(), 0.0f);
+        std::fill(acc_im.begin(), acc_im.end(), 0.0f);
+        for(size_t p = 0; p < partitions; p++) {
+            size_t slot = (current + partitions - p) % partitions;
+            const float *xr = &fdl_re[slot * bins * 2], *xi = &fdl_im[slot * bins * 2];
+            const float *hr = &h_re[p * bins * 2], *hi = &h_im[p * bins * 2];
+            for(size_t k = 0; k < bins * 2; k++) {
+                acc_re[k] += xr[k] * hr[k] - xi[k] * hi[k];
+                acc_im[k] += xr[k] * hi[k] + xi[k] * hr[k];
+            }
+        }
+        
+        // the second half is the part circular convolution didn't wrap into
+        for(int c = 0; c < 2; c++) {
+            fft->inverseReal(&acc_re[c * bins], &acc_im[c * bins], time.data());
+            for(size_t i = 0; i < block; i++) output[i * 2 + c] = time[block + i];
+        }
+        memmove(input_l.data(), input_l.data() + block, block * sizeof(float));
+        memmove(input_r.data(), input_r.data() + block, block * sizeof(float));
+        current = (current + 1) % partitions;
+        fill = 0;
+    }
+
+    size_t block;
+    size_t partitions = 0;
+    std::shared_ptr<const FFT> fft;
+    std::vector<float> h_re, h_im;              // left then right response spectra per partition
+    std::vector<float> fdl_re, fdl_im;          // left then right input spectra of the last partitions blocks
+    std::vector<float> input_l, input_r;        // the last two blocks of input
+    std::vector<float> time;
+    std::vector<float> acc_re, acc_im;
+    std::vector<float> output;                  // interleaved wet output of the last block
+    size_t fill = 0;
+    size_t current = 0;
+};
+
+/************************************************************************
+ * FDN reverb
+ ************************************************************************/
+
+// algorithmic reverb cheap enough for low-end phones: a feedback delay network with Householder feedback,
+// damping and optional read modulation per line. Lines are SIMD lanes and share one interleaved
+// power-of-two ring, so a frame writes one contiguous row
+class FDNReverb : public Filter {
+public:
+    static constexpr size_t MAX_LINES = 16;
+
+    explicit FDNReverb(int quality = AUDIOLIB_REVERB_MEDIUM) {
+        lines = quality == AUDIOLIB_REVERB_HIGH ? 16 : 8;
+        modulated = quality != AUDIOLIB_REVERB_LOW;
+        setRoom(1.0f, 1.8f, 0.3f);
+    }
+
+    // size scales the delay lines (1 is a mid-sized hall), decay is the RT60 in seconds and damping
+    // in [0, 1] shortens the decay of high frequencies; clears the tail
+    void setRoom(float size, float decay, float _damping) {
+        // lengths spread exponentially between 21 and 61 ms, rounded to primes so no two lines share echoes
+        auto prime = [](size_t v) {
+            for(;; v++) {
+                bool ok = v > 1;
+                for(size_t d = 2; d * d <= v && ok; d++) ok = v % d != 0;
+                if(ok) return v;
+            }
+        };
+        size = std::max(size, 0.1f);
+        double shortest = 0.021 * OUTPUT_FREQ * size, longest = 0.061 * OUTPUT_FREQ * size;
+        depth = modulated ? 4.0f * std::min(size, 2.0f) : 0.0f;
+        size_t longest_line = 0;
+        float scale = 1.0f / std::sqrt(float(8 * lines));   // same loudness for 8 and 16 lines
+        for(size_t l = 0; l < lines; l++) {
+            delay_frames[l] = prime(size_t(shortest * std::pow(longest / shortest, double(l) / double(lines - 1))));
+            delay[l] = float(delay_frames[l]);
+            gain[l] = float(std::pow(10.0, -3.0 * double(delay_frames[l]) / (std::max(decay, 0.05f) * double(OUTPUT_FREQ))));
+            longest_line = std::max(longest_line, delay_frames[l]);
+            
+            // left feeds the even lines and right the odd ones, the taps are two orthogonal sign patterns
+            float sign = (l & 2) ? -1.0f : 1.0f;
+            input_l[l] = (l & 1) ? 0.0f : sign;
+            input_r[l] = (l & 1) ? sign : 0.0f;
+            tap_l[l] = (l & 1) ? -scale : scale;
+            tap_r[l] = (l & 4) ? -scale : scale;
+            
+            double rate = 2.0 * 3.14159265358979323846 * (0.3 + 0.11 * double(l)) / OUTPUT_FREQ;
+            rotate_cos[l] = float(std::cos(rate));
+            rotate_sin[l] = float(std::sin(rate));
+        }
+        damping = std::min(std::max(_damping, 0.0f), 1.0f) * 0.9f;
+        
+        ring = 1;
+        while(ring < longest_line + size_t(depth) + 2) ring <<= 1;
+        buffer.assign(ring * lines, 0.0f);
+        reset();
+    }
+
+    void reset() {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        for(size_t l = 0; l < lines; l++) {
+            double phase = 2.0 * 3.14159265358979323846 * double(l) / double(lines);
+            lfo_cos[l] = float(std::cos(phase));
+            lfo_sin[l] = float(std::sin(phase));
+            damp_state[l] = 0.0f;
+        }
+        pos = 0;
+    }
+
+    // delays and decay are set up at OUTPUT_FREQ, on a bus at any other rate (a voice filter chain
+    // of a low-rate sound) data passes through unchanged, like ConvolutionReverb
+    void process(float *data, size_t frames, int freq) override {
+        if(freq != OUTPUT_FREQ) return;
+#if defined(AUDIOLIB_AVX)
+        run<simd::Vec8>(data, frames);
+#elif defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+        run<simd::Vec4>(data, frames);
+#else
+        run<simd::Scalar>(data, frames);
+#endif
+    }
+
+    float wet = 0.3f;
+    float dry = 1.0f;
+
+private:
+    // line reads are gathered straight into vectors and the feedback sum and both output taps
+    // share one horizontal reduction per frame
+    template<class V> void run(float *data, size_t frames) {
+        typedef typename V::type vec;
+        const size_t n = lines, mask = ring - 1;
+        const float feedback = -2.0f / float(n);
+        const vec damp = V::set1(damping), mod_depth = V::set1(depth);
+        float next[MAX_LINES];
+        for(size_t i = 0; i < frames; i++) {
+            float in_l = data[i * 2], in_r = data[i * 2 + 1];
+            const float row_read = float(pos + ring);
+            
+            // line outputs, each read its delay behind the row written last, then damping and decay
+            vec sum = V::set1(0.0f), wet_l = sum, wet_r = sum;
+            for(size_t l = 0; l < n; l += V::width) {
+                size_t index[V::width];
+                vec x;
+                if(modulated) {
+                    vec c = V::load(lfo_cos + l), s = V::load(lfo_sin + l);
+                    vec rc = V::load(rotate_cos + l), rs = V::load(rotate_sin + l);
+                    V::store(lfo_cos + l, V::sub(V::mul(c, rc), V::mul(s, rs)));
+                    V::store(lfo_sin + l, V::add(V::mul(s, rc), V::mul(c, rs)));
+                    vec read = V::sub(V::set1(row_read), V::add(V::load(delay + l), V::mul(s, mod_depth)));
+                    int32_t whole[V::width];
+                    vec t = V::fraction(read, whole);
+                    size_t next_index[V::width];
+                    for(size_t j = 0; j < V::width; j++) {
+                        size_t frame = size_t(whole[j]);
+                        index[j] = (frame & mask) * n + l + j;
+                        next_index[j] = ((frame + 1) & mask) * n + l + j;
+                    }
+                    vec a = V::gather(buffer.data(), index), b = V::gather(buffer.data(), next_index);
+                    x = V::add(a, V::mul(V::sub(b, a), t));
+                } else {
+                    for(size_t j = 0; j < V::width; j++) index[j] = ((pos - delay_frames[l + j]) & mask) * n + l + j;
+                    x = V::gather(buffer.data(), index);
+                }
+                vec d = V::load(damp_state + l);
+                d = V::add(x, V::mul(V::sub(d, x), damp));
+                V::store(damp_state + l, d);
+                d = V::mul(d, V::load(gain + l));
+                V::store(next + l, d);
+                sum = V::add(sum, d);
+                wet_l = V::add(wet_l, V::mul(x, V::load(tap_l + l)));
+                wet_r = V::add(wet_r, V::mul(x, V::load(tap_r + l)));
+            }
+            float sums[3];
+            V::sums(sum, wet_l, wet_r, sums);
+            
+            // the Householder reflection I - 2/n and the input; the tiny offset keeps the decaying tail out of denormals
+            vec reflect = V::set1(sums[0] * feedback + 1e-20f);
+            vec left = V::set1(in_l), right = V::set1(in_r);
+            float *row = buffer.data() + pos * n;
+            for(size_t l = 0; l < n; l += V::width) {
+                vec input = V::add(V::mul(left, V::load(input_l + l)), V::mul(right, V::load(input_r + l)));
+                V::store(row + l, V::add(V::add(V::load(next + l), reflect), input));
+            }
+            data[i * 2] = dry * in_l + wet * sums[1];
+            data[i * 2 + 1] = dry * in_r + wet * sums[2];
+            pos = (pos + 1) & mask;
+        }
+        
+        // keeps the oscillators on the unit circle
+        for(size_t l = 0; modulated && l < n; l++) {
+            float r = 1.0f / std::sqrt(lfo_cos[l] * lfo_cos[l] + lfo_sin[l] * lfo_sin[l]);
+            lfo_cos[l] *= r;
+            lfo_sin[l] *= r;
+        }
+    }
+
+    size_t lines = 8;
+    bool modulated = true;
+    float depth = 0.0f;         // modulation in frames
+    float damping = 0.0f;
+    size_t delay_frames[MAX_LINES];
+    float delay[MAX_LINES];
+    float gain[MAX_LINES];
+    float input_l[MAX_LINES], input_r[MAX_LINES];
+    float tap_l[MAX_LINES], tap_r[MAX_LINES];
+    float damp_state[MAX_LINES];
+    float lfo_cos[MAX_LINES], lfo_sin[MAX_LINES];
+    float rotate_cos[MAX_LINES], rotate_sin[MAX_LINES];
+    std::vector<float> buffer;  // ring rows of one value per line
+    size_t ring = 0;
+    size_t pos = 0;
 };
 
 /************************************************************************
@@ -423,7 +3303,278 @@ struct Backend {
     SLBufferQueueItf queue = nullptr;
     uint8_t buffer[2][BUFFER_SIZE];
 };
+
+#else
+// no output device, the application pulls mixed blocks with Manager::fillBuffer (tests, benchmarks, offline rendering)
+struct Backend {
+    explicit Backend(Manager*) { }
+};
+#endif
+
+/************************************************************************
+ * Decode pool
+ ************************************************************************/
+
+class DecodePool {
+public:
+    DecodePool(size_t count = std::max(std::thread::hardware_concurrency(), 2u) - 1) {
+        for(size_t i = 0; i < count; i++) threads.emplace_back([this] { work(); });
+    }
+
+    ~DecodePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        for(auto &t : threads) t.join();
+    }
+
+    void run(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+
+    // blocks until every queued job has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle_cv.wait(lock, [this] { return jobs.empty() && !busy; });
+    }
+
+private:
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            cv.wait(lock, [this] { return quit || !jobs.empty(); });
+            if(jobs.empty()) return;
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+            busy++;
+            lock.unlock();
+            job();
+            lock.lock();
+            busy--;
+            if(jobs.empty() && !busy) idle_cv.notify_all();
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv, idle_cv;
+    size_t busy = 0;
+    bool quit = false;
+};
+
+/************************************************************************
+ * Mixer
+ ************************************************************************/
+
+// voices sharing a source rate are summed here at that rate and upsampled once into the output bus,
+// with one buffer for the dry mix and one per send bus.
+// The upsampler has no lookahead, so a voice on a sub-bus sounds RESAMPLE_DELAY source frames after
+// one at OUTPUT_FREQ started in the same block: 4 output frames at 22050 Hz, 8 at 11025 Hz. This is
+// not compensated, as that would delay every native rate voice by the longest sub-bus lag. Sounds
+// loaded with AUDIOLIB_LOAD_RESAMPLE keep the same lag; sounds that must line up with native ones
+// to the sample have to be shipped at OUTPUT_FREQ
+struct SubBus {
+    explicit SubBus(int _freq) : freq(_freq), step((uint32_t(_freq) << 16) / OUTPUT_FREQ) {
+        for(auto &b : buffers) b.resize((SAMPLE_COUNT + HISTORY) * 2);
+    }
+
+    float *data(size_t target = 0) { return buffers[target].data() + HISTORY * 2; }
+    
+    // source frames to mix so the last tap of the last output frame is covered; a block that ends inside
+    // a source frame leaves it for the next one, which is why pos runs up to two frames into the history
+    size_t frames(size_t out_frames) const { return out_frames ? (pos + step * uint32_t(out_frames - 1)) >> 16 : 0; }
+    
+    void clear(size_t frames, size_t targets) {
+        for(size_t t = 0; t < targets; t++) std::fill(data(t), data(t) + frames * 2, 0.0f);
+    }
+
+    // cubic interpolation into dst for the targets in mask, delayed by RESAMPLE_DELAY so no lookahead is needed
+    void resample(float *const *dst, uint32_t mask, size_t out_frames) {
+        size_t frames = this->frames(out_frames);
+        uint32_t start = pos;
+        for(size_t target = 0; target < MAX_SENDS + 1; target++) {
+            if(!(mask & (1u << target))) continue;
+            std::vector<float> &buffer = buffers[target];
+            const float *src = buffer.data();
+            float *out = dst[target];
+            pos = start;
+            for(size_t i = 0; i < out_frames; i++) {
+                const float *w = src + (pos >> 16) * 2;
+                float t = (pos & 0xffff) * (1.0f / 65536.0f);
+                const float l[] = { w[0], w[2], w[4], w[6] };
+                const float r[] = { w[1], w[3], w[5], w[7] };
+                out[i*2  ] += hermite(l, t);
+                out[i*2+1] += hermite(r, t);
+                pos += step;
+            }
+            std::copy(buffer.data() + frames * 2, buffer.data() + (frames + HISTORY) * 2, buffer.begin());
+        }
+        pos = start + step * uint32_t(out_frames) - (uint32_t(frames) << 16);
+    }
+
+    static constexpr size_t HISTORY = RESAMPLE_DELAY + 2;
+    int freq;
+    uint32_t step;
+    uint32_t pos = 1 << 16;     // 16.16 into the buffer, the first output frame reads RESAMPLE_DELAY frames back
+    uint32_t active = 0;        // targets written in the last block
+    std::vector<float> buffers[MAX_SENDS + 1];
+};
+
+// auxiliary bus fed by Sound::sends, processed once for every voice sending to it and added to the master bus
+struct SendBus {
+    std::string name;
+    FilterChain filters;
+    float level = 1.0f;
+    std::vector<float> buffer;
+};
+
+// master bus dynamics: an optional compressor followed by a lookahead peak limiter. Gains are set per
+// chunk of half the lookahead and ramp linearly across it; a chunk boundary never gets more gain than the
+// chunks on either side allow, so the output stays under the ceiling without clipping
+class Limiter {
+public:
+    static constexpr size_t MAX_LOOKAHEAD = SAMPLE_COUNT;
+
+    Limiter() {
+        buffer.assign(MAX_LOOKAHEAD / 2 * 3 * 2, 0.0f);
+        setLookahead(64);
+    }
+
+    // in frames, also the added latency; resets the limiter, set before playback starts
+    void setLookahead(size_t frames) {
+        chunk = std::min(std::max<size_t>(frames, 16), size_t(MAX_LOOKAHEAD)) / 2;
+        reset();
+    }
+
+    size_t getLatency() const { return chunk * 2; }
+
+    void reset() {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        for(int i = 0; i < 3; i++) chunks[i] = buffer.data() + i * chunk * 2;
+        fill = 0;
+        compression = limit = limit_needed = gain = 1.0f;
+    }
+
+    // current gain applied to the output, 1 when nothing is reduced
+    float getGain() const { return gain; }
+
+    // interleaved stereo at OUTPUT_FREQ in place
+    void process(float *data, size_t frames) {
+        while(frames) {
+            size_t count = std::min(frames, chunk - fill);
+            memcpy(chunks[2] + fill * 2, data, count * 2 * sizeof(float));
+            memcpy(data, chunks[0] + fill * 2, count * 2 * sizeof(float));
+            fill += count;
+            data += count * 2;
+            frames -= count;
+            if(fill == chunk) processChunk();
+        }
+    }
+
+    float ceiling = 0.97f;          // output peak limit
+    float release_ms = 60.0f;
+    
+    // compressor, off while ratio is 1
+    float threshold = 0.5f;         // peak level where compression starts
+    float ratio = 1.0f;
+    float attack_ms = 10.0f;
+    float compressor_release_ms = 150.0f;
+
+private:
+    // chunks[0] is being played, chunks[1] waits for the gains that need chunks[2], which is being filled
+    void processChunk() {
+        float peak = findPeak(chunks[2], chunk);
+        
+        // compressor gain at the end of the new chunk
+        float next_compression = compression;
+        if(ratio > 1.0f) {
+            float target = peak > threshold ? std::pow(peak / threshold, 1.0f / ratio - 1.0f) : 1.0f;
+            float ms = target < compression ? attack_ms : compressor_release_ms;
+            next_compression += (target - compression) * smoothing(ms);
+        }
+        
+        // limiter gain the new chunk needs, then the boundary between the waiting chunk and it
+        float level = peak * std::max(compression, next_compression);
+        float needed = level > ceiling ? ceiling / level : 1.0f;
+        float next_limit = std::min(std::min(limit_needed, needed), limit + (1.0f - limit) * smoothing(release_ms));
+        
+        float next_gain = compression * next_limit;
+        applyRamp(chunks[1], chunk, gain, next_gain);
+        gain = next_gain;
+        limit = next_limit;
+        limit_needed = needed;
+        compression = next_compression;
+        
+        float *played = chunks[0];
+        chunks[0] = chunks[1];
+        chunks[1] = chunks[2];
+        chunks[2] = played;
+        fill = 0;
+    }
+
+    // one-pole coefficient per chunk for a time constant
+    float smoothing(float ms) const {
+        return 1.0f - std::exp(-float(chunk) / (std::max(ms, 0.01f) * 0.001f * OUTPUT_FREQ));
+    }
+
+    static float findPeak(const float *data, size_t frames) {
+        size_t i = 0, n = frames * 2;
+        float peak = 0.0f;
+#if defined(AUDIOLIB_SSE2)
+        const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 m = _mm_setzero_ps();
+        for(; i + 4 <= n; i += 4) m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(data + i), mask));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        peak = _mm_cvtss_f32(m);
+#elif defined(AUDIOLIB_NEON)
+        float32x4_t m = vdupq_n_f32(0.0f);
+        for(; i + 4 <= n; i += 4) m = vmaxq_f32(m, vabsq_f32(vld1q_f32(data + i)));
+        float32x2_t h = vpmax_f32(vget_low_f32(m), vget_high_f32(m));
+        peak = vget_lane_f32(vpmax_f32(h, h), 0);
+#endif
+        for(; i < n; i++) peak = std::max(peak, std::fabs(data[i]));
+        return peak;
+    }
+
+    static void applyRamp(float *data, size_t frames, float from, float to) {
+        float step = (to - from) / float(frames);
+        size_t i = 0;
+#if defined(AUDIOLIB_SSE2)
+        __m128 g = _mm_setr_ps(from, from, from + step, from + step);
+        const __m128 d = _mm_set1_ps(step * 2.0f);
+        for(; i + 2 <= frames; i += 2) {
+            _mm_storeu_ps(data + i * 2, _mm_mul_ps(_mm_loadu_ps(data + i * 2), g));
+            g = _mm_add_ps(g, d);
+        }
+#elif defined(AUDIOLIB_NEON)
+        float32x4_t g = { from, from, from + step, from + step };
+        const float32x4_t d = vdupq_n_f32(step * 2.0f);
+        for(; i + 2 <= frames; i += 2) {
+            vst1q_f32(data + i * 2, vmulq_f32(vld1q_f32(data + i * 2), g));
+            g = vaddq_f32(g, d);
+        }
 #endif
+        for(; i < frames; i++) {
+            float gain = from + step * float(i);
+            data[i * 2] *= gain;
+            data[i * 2 + 1] *= gain;
+        }
+    }
+
+    std::vector<float> buffer;      // three chunks
+    float *chunks[3];
+    size_t chunk = 0;
+    size_t fill = 0;
+    float compression, limit, limit_needed, gain;
+};
 
 /************************************************************************
  * Manager
@@ -436,32 +3587,91 @@ static std::string strlow(const std::string &_str) {
     return temp;
 }
 
+struct MemoryStats {
+    size_t sounds = 0;
+    size_t pcm_bytes = 0;           // sample data kept at the source rate
+    size_t resampled_bytes = 0;     // sample data converted to OUTPUT_FREQ at load time
+    size_t adpcm_bytes = 0;         // sample data kept as IMA-ADPCM
+    size_t compressed_bytes = 0;    // encoded files kept for decoding while playing
+    size_t mapped_bytes = 0;        // sample data mapped from the decode cache
+    size_t mip_bytes = 0;           // AUDIOLIB_LOAD_PITCHED half-band copies
+};
+
 class Manager {
 public:
     Manager() {
-        temp_buf = new int16_t[BUFFER_SIZE / sizeof(int16_t)];
+        temp_buf = new float[SAMPLE_COUNT * 2];
+        group_buf = new float[SAMPLE_COUNT * 2 * FilterBank::VOICES]();
+        master_buf = new float[SAMPLE_COUNT * 2];
+        for(int freq : { 22050, 11025 }) sub_buses.emplace_back(freq);
         backend = new Backend(this);
     }
     
     ~Manager() {
         delete backend;
+        delete pool;
         delete [] temp_buf;
+        delete [] group_buf;
+        delete [] master_buf;
+        stb_vorbis_flush_setup_cache();
     }
     
-    Sound *load(const std::string &path, int32_t _is_loop, int32_t *err) {
-        std::string ext;
-        size_t dot = path.rfind('.');
-        if(dot != std::string::npos) ext = path.substr(dot+1, path.length() - dot - 1);
-        ext = strlow(ext);
+    // names in opened banks are found before files on disk
+    Sound *load(const std::string &path, int32_t _is_loop, int32_t *err, uint32_t flags = AUDIOLIB_LOAD_DEFAULT) {
+        std::string ext = getExtension(path);
+        const Bank *bank = nullptr;
+        const BankEntry *entry = nullptr;
+        for(size_t i = 0; i < banks.size() && !entry; i++) {
+            bank = &banks[i];
+            entry = bank->find(path);
+        }
+        
+        Sound *ret = nullptr;
+        if(entry) ret = entry->type == AUDIOLIB_BANK_OGG ? static_cast<Sound*>(new SoundOGG()) : new SoundWAV();
+        else if(ext == "wav") ret = new SoundWAV();
+        else if(ext == "ogg") ret = new SoundOGG();
+        else return nullptr;
+        
+        ret->flags = flags;
+#ifdef AUDIOLIB_MMAP
+        if(flags & AUDIOLIB_LOAD_STREAM) ret->io = getIOQueue();
+#endif
+        if(flags & AUDIOLIB_LOAD_STREAM) ret->streamer = getStreamThread();
+        bool cached = !(flags & (AUDIOLIB_LOAD_COMPRESSED | AUDIOLIB_LOAD_STREAM)) && !cache_dir.empty();
+        if(entry) cached = cached && entry->type == AUDIOLIB_BANK_OGG && setCachePath(ret, bank->getData(*entry), size_t(entry->size), _is_loop);
+        else cached = cached && ext == "ogg" && setCachePath(ret, path, _is_loop);
+        if(cached && ret->readCache(path, _is_loop)) {
+            *err = AUDIOLIB_SUCCESS;
+            if(ret->needsConversion()) startConversion(ret);
+            sounds.push_back(ret);
+            return ret;
+        }
         
+        *err = entry ? ret->loadEntry(*bank, *entry, _is_loop) : ret->load(path,_is_loop);
+        return finishLoad(ret, *err);
+    }
+
+    // sound read from an archive, memory or custom storage, name picks the decoder by its extension
+    Sound *load(std::unique_ptr<Reader> reader, const std::string &name, int32_t _is_loop, int32_t *err, uint32_t flags = AUDIOLIB_LOAD_DEFAULT) {
+        std::string ext = getExtension(name);
         Sound *ret = nullptr;
         if(ext == "wav") ret = new SoundWAV();
         else if(ext == "ogg") ret = new SoundOGG();
         else return nullptr;
         
-        *err = ret->load(path,_is_loop);
-        sounds.push_back(ret);
-        return ret;
+        ret->flags = flags;
+        ret->filename = name;
+        if(flags & AUDIOLIB_LOAD_STREAM) ret->streamer = getStreamThread();
+        bool cached = !(flags & (AUDIOLIB_LOAD_COMPRESSED | AUDIOLIB_LOAD_STREAM)) && !cache_dir.empty() && ext == "ogg";
+        if(cached && reader && reader->map() && setCachePath(ret, reader->map(), reader->size(), _is_loop) && ret->readCache(name, _is_loop)) {
+            *err = AUDIOLIB_SUCCESS;
+            if(ret->needsConversion()) startConversion(ret);
+            sounds.push_back(ret);
+            return ret;
+        }
+        
+        *err = reader ? ret->loadFrom(std::move(reader), _is_loop) : AUDIOLIB_FILE_ERROR;
+        return finishLoad(ret, *err);
     }
 
     template<class T> Sound *load() {
@@ -472,23 +3682,346 @@ public:
     }
     
     void free(Sound *p) {
+        p->waitJobs();
         auto it = std::remove(sounds.begin(), sounds.end(), p);
         sounds.erase(it, sounds.end());
         delete p;
     }
     
     void fillBuffer(void *buf, size_t samples) {
-        for(auto *s : sounds) s->fillBuffer(buf,prev_buffer,temp_buf,samples);
-        prev_buffer = buf;
+        size_t buses = bus_count.load();
+        float *targets[MAX_SENDS + 1] = { master_buf };
+        for(size_t k = 0; k < buses; k++) targets[k + 1] = send_buses[k].buffer.data();
+        for(size_t t = 0; t <= buses; t++) std::fill(targets[t], targets[t] + samples * 2, 0.0f);
+        
+        for(auto *s : sounds) s->applyPending();
+        mixVoices(targets, OUTPUT_FREQ, samples);
+        
+        // one resample per source rate and bus instead of one per voice
+        for(auto &bus : sub_buses) {
+            size_t frames = bus.frames(samples);
+            float *bus_targets[MAX_SENDS + 1] = { };
+            for(size_t t = 0; t <= buses; t++) bus_targets[t] = bus.data(t);
+            uint32_t was_active = bus.active;
+            bus.clear(frames, buses + 1);
+            bus.active = mixVoices(bus_targets, bus.freq, frames);
+            if(bus.active || was_active) bus.resample(targets, bus.active | was_active, samples);
+        }
+
+#ifdef AUDIOLIB_MMAP
+        // reads the voices queued ahead while mixing go to the kernel together
+        if(io) io->flush();
+#endif
+        // tops up what the streaming voices just played
+        if(streamer) streamer->wake();
+
+        // send buses keep running while nobody sends so that reverb tails ring out
+        for(size_t k = 0; k < buses; k++) {
+            SendBus &send = send_buses[k];
+            send.filters.process(targets[k + 1], samples, OUTPUT_FREQ);
+            for(size_t i = 0; i < samples * 2; i++) master_buf[i] += targets[k + 1][i] * send.level;
+        }
+
+        filters.process(master_buf, samples, OUTPUT_FREQ);
+        limiter.process(master_buf, samples);
+
+        int16_t *outbuf = static_cast<int16_t*>(buf);
+        for(size_t i = 0; i < samples * 2; i++) {
+            int32_t v = outbuf[i] + int32_t(master_buf[i] * 32768.0f);
+            outbuf[i] = std::min(std::max(v, -32768), 32767);
+        }
+    }
+
+    MemoryStats getMemoryStats() const {
+        MemoryStats ret;
+        for(auto *s : sounds) {
+            ret.sounds++;
+            if(s->isMapped()) ret.mapped_bytes += s->getMemorySize();
+            else if(s->getFormat() == AUDIOLIB_FORMAT_ADPCM) ret.adpcm_bytes += s->getMemorySize();
+            else if(s->isResampled()) ret.resampled_bytes += s->getMemorySize();
+            else ret.pcm_bytes += s->getMemorySize();
+            ret.compressed_bytes += s->getCompressedSize();
+            ret.mip_bytes += s->getMipSize();
+        }
+        return ret;
+    }
+
+    DecodePool *getDecodePool() {
+        if(!pool) pool = new DecodePool();
+        return pool;
+    }
+
+#ifdef AUDIOLIB_MMAP
+    // shared by every AUDIOLIB_LOAD_STREAM sound, created with the first one
+    const std::shared_ptr<IOQueue> &getIOQueue() {
+        if(!io) io = std::make_shared<IOQueue>();
+        return io;
+    }
+#endif
+
+    // decodes every AUDIOLIB_LOAD_STREAM sound ahead of playback, created with the first one
+    const std::shared_ptr<StreamThread> &getStreamThread() {
+        if(!streamer) streamer = std::make_shared<StreamThread>();
+        return streamer;
     }
 
     Backend *getBackend() const { return backend; }
+
+    // runs on the mixed output before it's converted to 16 bit
+    FilterChain &getFilters() { return filters; }
+
+    // after the filters, keeps the output from clipping
+    Limiter &getLimiter() { return limiter; }
+
+    // send bus that Sound::sends[index] feeds, the same index for a name already added; -1 once MAX_SENDS exist
+    int addBus(const std::string &name) {
+        size_t count = bus_count.load();
+        for(size_t k = 0; k < count; k++) {
+            if(send_buses[k].name == name) return int(k);
+        }
+        if(count == MAX_SENDS) return -1;
+        send_buses[count].name = name;
+        send_buses[count].buffer.assign(SAMPLE_COUNT * 2, 0.0f);
+        bus_count.store(count + 1);
+        return int(count);
+    }
+
+    int findBus(const std::string &name) const {
+        for(size_t k = 0; k < bus_count.load(); k++) {
+            if(send_buses[k].name == name) return int(k);
+        }
+        return -1;
+    }
+
+    SendBus &getBus(int index) { return send_buses[index]; }
+
+    // existing directory where decoded OGG files are kept between runs, empty disables the cache
+    void setCacheDirectory(const std::string &dir) { cache_dir = dir; }
+    
+    // maps a bank written by BankBuilder, load() then accepts the names stored in it
+    bool openBank(const std::string &path) {
+        Bank bank;
+        if(!bank.open(path)) return false;
+        banks.push_back(bank);
+        return true;
+    }
     
 private:
+    // voices at freq into the targets, the ones with a filter slot rendered side by side and filtered together;
+    // returns a bit per target written
+    uint32_t mixVoices(float *const *targets, int freq, size_t frames) {
+        uint32_t active = 0;
+        Sound *group[FilterBank::VOICES];
+        size_t count = 0;
+        for(auto *s : sounds) {
+            if(s->freq != freq) continue;
+            if(s->filter.type == AUDIOLIB_FILTER_NONE) {
+                s->filter_state.active = false;
+                active |= s->mix(targets, temp_buf, frames);
+            } else if(s->is_playing && s->data) {
+                group[count++] = s;
+                if(count == FilterBank::VOICES) {
+                    active |= mixGroup(targets, group, count, frames);
+                    count = 0;
+                }
+            }
+        }
+        if(count) active |= mixGroup(targets, group, count, frames);
+        return active;
+    }
+
+    uint32_t mixGroup(float *const *targets, Sound *const *group, size_t count, size_t frames) {
+        float *voices[FilterBank::VOICES];
+        for(size_t v = 0; v < FilterBank::VOICES; v++) {
+            voices[v] = group_buf + v * SAMPLE_COUNT * 2;
+            if(v < count) {
+                group[v]->render(voices[v], frames);
+                filter_bank.load(v, group[v]->filter, group[v]->filter_state, group[v]->freq, frames);
+            } else {
+                filter_bank.clear(v);
+            }
+        }
+        filter_bank.process(voices, frames);
+        uint32_t written = 0;
+        for(size_t v = 0; v < count; v++) {
+            filter_bank.store(v, group[v]->filter_state);
+            written |= group[v]->addTo(targets, voices[v], frames);
+        }
+        return written;
+    }
+
+    static std::string getExtension(const std::string &path) {
+        size_t dot = path.rfind('.');
+        if(dot == std::string::npos) return std::string();
+        return strlow(path.substr(dot+1));
+    }
+
+    // background work and caching after a load
+    Sound *finishLoad(Sound *ret, int32_t err) {
+        if(err == AUDIOLIB_SUCCESS && ret->isStreaming() && ret->streamer) {
+            ret->streamer->add(ret, [ret] { ret->refill(); });
+        }
+        if(err == AUDIOLIB_SUCCESS && ret->isStreaming()) {
+            ret->beginJob();
+            getDecodePool()->run([ret] {
+                ret->buildSeekIndex();
+                ret->endJob();
+            });
+        }
+        if(err == AUDIOLIB_SUCCESS && ret->needsConversion()) {
+            startConversion(ret);
+        } else if(err == AUDIOLIB_SUCCESS && !ret->cache_path.empty()) {
+            ret->writeCache();
+        }
+        sounds.push_back(ret);
+        return ret;
+    }
+
+    void startConversion(Sound *ret) {
+        if(ret->flags & AUDIOLIB_LOAD_ASYNC) {
+            ret->beginJob();
+            getDecodePool()->run([ret] {
+                ret->convert(true);
+                ret->endJob();
+            });
+        } else {
+            ret->convert(false);
+        }
+    }
+
+    bool setCachePath(Sound *sound, const std::string &path, int32_t loop) const {
+        MappedFile source;
+        return source.open(path, true) && setCachePath(sound, source.data, source.size, loop);
+    }
+
+    // cache entries are keyed by the file contents and the load options that change the samples
+    bool setCachePath(Sound *sound, const uint8_t *data, size_t size, int32_t loop) const {
+        uint32_t options[] = { sound->flags & (AUDIOLIB_LOAD_RESAMPLE | AUDIOLIB_LOAD_ADPCM | AUDIOLIB_LOAD_FLOAT), uint32_t((sound->flags & AUDIOLIB_LOAD_RESAMPLE) ? loop : 0) };
+        uint64_t key = hashBytes(reinterpret_cast<const uint8_t*>(options), sizeof(options), hashBytes(data, size));
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.pcm", static_cast<unsigned long long>(key));
+        sound->cache_key = key;
+        sound->cache_path = cache_dir + name;
+        return true;
+    }
+
     Backend *backend = nullptr;
-    int16_t *temp_buf = nullptr;
+    DecodePool *pool = nullptr;
+    float *temp_buf = nullptr;
+    float *group_buf = nullptr;                 // FilterBank::VOICES rendered voices
+    FilterBank filter_bank;
+    float *master_buf = nullptr;
+    std::vector<SubBus> sub_buses;
     std::vector<Sound*> sounds;
-    void *prev_buffer = nullptr;
+    std::vector<Bank> banks;
+    std::string cache_dir;
+    std::shared_ptr<IOQueue> io;
+    std::shared_ptr<StreamThread> streamer;
+    FilterChain filters;
+    Limiter limiter;
+    SendBus send_buses[MAX_SENDS];
+    std::atomic<size_t> bus_count{0};
+};
+
+/************************************************************************
+ * Bank builder
+ ************************************************************************/
+
+// packs WAV and OGG files into one bank, WAV samples are stored ready to play and OGG files with their seek index
+class BankBuilder {
+public:
+    int32_t add(const std::string &name, const std::string &path) {
+        std::string ext = strlow(path.substr(std::min(path.rfind('.'), path.size())));
+        Item item;
+        item.name = name;
+        if(ext == ".wav") {
+            SoundWAV wav;
+            int32_t ret = wav.load(path, 0);
+            if(ret != AUDIOLIB_SUCCESS) return ret;
+            item.type = AUDIOLIB_BANK_SAMPLES;
+            item.info = SampleInfo { wav.size, wav.length, wav.format, wav.channels, wav.freq, wav.bps, wav.block_align, 0, wav.duration_sec, 0 };
+            item.payload.assign(wav.data, wav.data + wav.size);
+        } else if(ext == ".ogg") {
+            MappedFile file;
+            if(!file.open(path, false)) return AUDIOLIB_FILE_ERROR;
+            stb_vorbis *v = stb_vorbis_open_memory(file.data, int(file.size), nullptr, nullptr);
+            if(!v) return AUDIOLIB_DECODE_ERROR;
+            auto info = stb_vorbis_get_info(v);
+            size_t frames = stb_vorbis_stream_length_in_samples(v);
+            item.type = AUDIOLIB_BANK_OGG;
+            item.info = SampleInfo { 0, frames * info.channels, AUDIOLIB_FORMAT_PCM16, info.channels, int32_t(info.sample_rate), 16, 0, 0, float(frames) / info.sample_rate, 0 };
+            item.seek = buildSeekPoints(v, file.size);
+            stb_vorbis_close(v);
+            item.payload.assign(file.data, file.data + file.size);
+        } else {
+            return AUDIOLIB_FILE_ERROR;
+        }
+        items.erase(std::remove_if(items.begin(), items.end(), [&](const Item &i) { return i.name == name; }), items.end());
+        items.push_back(std::move(item));
+        return AUDIOLIB_SUCCESS;
+    }
+
+    bool write(const std::string &path) const {
+        std::vector<BankEntry> entries(items.size());
+        std::vector<size_t> order(items.size());
+        for(size_t i = 0; i < items.size(); i++) {
+            order[i] = i;
+            entries[i].hash = hashBytes(reinterpret_cast<const uint8_t*>(items[i].name.data()), items[i].name.size());
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].hash < entries[b].hash; });
+
+        // names right after the index, then seek points and payload of every entry
+        uint64_t offset = sizeof(BankHeader) + items.size() * sizeof(BankEntry);
+        for(size_t i : order) {
+            entries[i].name_offset = uint32_t(offset);
+            entries[i].name_size = uint32_t(items[i].name.size());
+            offset += items[i].name.size();
+        }
+        for(size_t i : order) {
+            const Item &item = items[i];
+            BankEntry &e = entries[i];
+            offset = (offset + 15) & ~uint64_t(15);
+            e.seek_offset = offset;
+            e.seek_count = uint32_t(item.seek.size());
+            offset += item.seek.size() * sizeof(stb_vorbis_seek_point);
+            offset = (offset + 63) & ~uint64_t(63);
+            e.offset = offset;
+            e.size = item.payload.size();
+            e.type = item.type;
+            e.info = item.info;
+            offset += item.payload.size();
+        }
+
+        std::vector<uint8_t> image(size_t(offset), 0);
+        BankHeader header = { BANK_MAGIC, BANK_VERSION, uint32_t(items.size()), 0 };
+        memcpy(image.data(), &header, sizeof(header));
+        uint8_t *index = image.data() + sizeof(header);
+        for(size_t i : order) {
+            const Item &item = items[i];
+            const BankEntry &e = entries[i];
+            memcpy(index, &e, sizeof(e));
+            index += sizeof(e);
+            memcpy(image.data() + e.name_offset, item.name.data(), item.name.size());
+            if(!item.seek.empty()) memcpy(image.data() + e.seek_offset, item.seek.data(), item.seek.size() * sizeof(stb_vorbis_seek_point));
+            if(!item.payload.empty()) memcpy(image.data() + e.offset, item.payload.data(), item.payload.size());
+        }
+
+        FILE *out = fopen(path.c_str(), "wb");
+        if(!out) return false;
+        bool ok = fwrite(image.data(),image.size(),1,out) == 1;
+        fclose(out);
+        return ok;
+    }
+
+private:
+    struct Item {
+        std::string name;
+        uint32_t type = AUDIOLIB_BANK_SAMPLES;
+        SampleInfo info;
+        std::vector<uint8_t> payload;
+        std::vector<stb_vorbis_seek_point> seek;
+    };
+    std::vector<Item> items;
 };
 
 /************************************************************************
@@ -0,0 +1,45 @@
+// ConvolutionReverb cost against impulse response length and partition block size,
+// fed SAMPLE_COUNT frames per call like the master bus
+#include "../AudioLib.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace AudioLib;
+
+int main() {
+    const float lengths[] = { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f };
+    const size_t blocks[] = { 64, 128, 256, 512, 1024 };
+    const size_t total = OUTPUT_FREQ * 10;
+    
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    std::vector<float> input(SAMPLE_COUNT * 2), data(SAMPLE_COUNT * 2);
+    for(float &v : input) v = noise(gen) * 0.25f;
+    
+    printf("ns per stereo frame (%% of one core at %d Hz)\n%8s", OUTPUT_FREQ, "IR \\ blk");
+    for(size_t block : blocks) printf("%16zu", block);
+    printf("\n");
+    for(float seconds : lengths) {
+        std::vector<float> ir(size_t(seconds * OUTPUT_FREQ) * 2);
+        for(size_t i = 0; i < ir.size(); i++) ir[i] = noise(gen) * std::exp(-6.9f * float(i / 2) / (ir.size() / 2));
+        printf("%7.2fs", seconds);
+        for(size_t block : blocks) {
+            ConvolutionReverb reverb(block);
+            reverb.setImpulse(ir.data(), ir.size() / 2, 2);
+            auto run = [&](size_t frames) {
+                for(size_t done = 0; done < frames; done += SAMPLE_COUNT) {
+                    data = input;
+                    reverb.process(data.data(), SAMPLE_COUNT, OUTPUT_FREQ);
+                }
+            };
+            run(OUTPUT_FREQ);
+            auto start = std::chrono::steady_clock::now();
+            run(total);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / total;
+            printf("%9.1f (%4.1f%%)", ns, ns * OUTPUT_FREQ * 1e-7);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+// FDNReverb cost per stereo frame for each quality preset, fed SAMPLE_COUNT frames per call like a send bus.
+// Cycles are time stamp counter ticks on x86; `make bench` also runs a build with AUDIOLIB_NO_SIMD
+#include "../AudioLib.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+using namespace AudioLib;
+
+int main() {
+    const char *names[] = { "low", "medium", "high" };
+    const int runs = 200;
+    
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    std::vector<float> input(SAMPLE_COUNT * 2), data(SAMPLE_COUNT * 2);
+    for(float &v : input) v = noise(gen) * 0.25f;
+    
+#if defined(AUDIOLIB_AVX)
+    const char *path = "AVX";
+#elif defined(AUDIOLIB_SSE2) || defined(AUDIOLIB_NEON)
+    const char *path = "4 lanes";
+#else
+    const char *path = "scalar";
+#endif
+    printf("FDN reverb, %s\n%8s %14s %10s %10s\n", path, "quality", "cycles/frame", "ns/frame", "% core");
+    for(int quality : { AUDIOLIB_REVERB_LOW, AUDIOLIB_REVERB_MEDIUM, AUDIOLIB_REVERB_HIGH }) {
+        FDNReverb reverb(quality);
+        // best of the runs for cycles, the average for time
+        double best = 1e30;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < runs; i++) {
+            data = input;
+#ifdef HAVE_TSC
+            uint64_t t = __rdtsc();
+            reverb.process(data.data(), SAMPLE_COUNT, OUTPUT_FREQ);
+            best = std::min(best, double(__rdtsc() - t) / SAMPLE_COUNT);
+#else
+            reverb.process(data.data(), SAMPLE_COUNT, OUTPUT_FREQ);
+#endif
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (runs * SAMPLE_COUNT);
+#ifdef HAVE_TSC
+        printf("%8s %14.1f %10.1f %9.2f%%\n", names[quality], best, ns, ns * OUTPUT_FREQ * 1e-7);
+#else
+        printf("%8s %14s %10.1f %9.2f%%\n", names[quality], "-", ns, ns * OUTPUT_FREQ * 1e-7);
+#endif
+    }
+    return 0;
+}
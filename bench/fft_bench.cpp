@@ -0,0 +1,67 @@
+// FFT::forward against a naive DFT for every supported size: ns per transform (the FFT time includes
+// copying the input in), speedup and the largest difference between the two relative to the largest
+// output. The DFT is O(n^2), the 65536 point one alone takes several seconds
+#include "../AudioLib.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace AudioLib;
+
+// out[k] = sum in[j] e^(-2 pi i jk / n), twiddles from a table of n entries
+static void dft(const float *re, const float *im, const float *cos_table, const float *sin_table, size_t n, float *out_re, float *out_im) {
+    for(size_t k = 0; k < n; k++) {
+        double sum_re = 0, sum_im = 0;
+        for(size_t j = 0, t = 0; j < n; j++, t = (t + k) & (n - 1)) {
+            sum_re += re[j] * cos_table[t] + im[j] * sin_table[t];
+            sum_im += im[j] * cos_table[t] - re[j] * sin_table[t];
+        }
+        out_re[k] = float(sum_re);
+        out_im[k] = float(sum_im);
+    }
+}
+
+// ns per call of f, repeated for at least min_ms
+template<class F> static double measure(F f, double min_ms) {
+    size_t runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    double ms;
+    do {
+        f();
+        runs++;
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    } while(ms < min_ms);
+    return ms * 1e6 / runs;
+}
+
+int main() {
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    
+    printf("%8s %14s %14s %10s %10s\n", "size", "FFT ns", "DFT ns", "speedup", "max error");
+    for(size_t n = FFT::MIN_SIZE; n <= FFT::MAX_SIZE; n *= 2) {
+        auto fft = FFT::get(n);
+        std::vector<float> re(n), im(n), work_re(n), work_im(n), dft_re(n), dft_im(n), cos_table(n), sin_table(n);
+        for(size_t i = 0; i < n; i++) {
+            re[i] = noise(gen);
+            im[i] = noise(gen);
+            cos_table[i] = float(std::cos(2.0 * 3.14159265358979323846 * double(i) / double(n)));
+            sin_table[i] = float(std::sin(2.0 * 3.14159265358979323846 * double(i) / double(n)));
+        }
+        
+        double fft_ns = measure([&] {
+            std::copy(re.begin(), re.end(), work_re.begin());
+            std::copy(im.begin(), im.end(), work_im.begin());
+            fft->forward(work_re.data(), work_im.data());
+        }, 200.0);
+        double dft_ns = measure([&] { dft(re.data(), im.data(), cos_table.data(), sin_table.data(), n, dft_re.data(), dft_im.data()); }, 200.0);
+        
+        float peak = 0.0f, error = 0.0f;
+        for(size_t i = 0; i < n; i++) {
+            peak = std::max(peak, std::max(std::fabs(dft_re[i]), std::fabs(dft_im[i])));
+            error = std::max(error, std::max(std::fabs(work_re[i] - dft_re[i]), std::fabs(work_im[i] - dft_im[i])));
+        }
+        printf("%8zu %14.1f %14.1f %9.0fx %10.2e\n", n, fft_ns, dft_ns, dft_ns / fft_ns, error / peak);
+    }
+    return 0;
+}
@@ -158,6 +158,11 @@ extern int stb_vorbis_get_error(stb_vorbis *f);
 // close an ogg vorbis file and free all memory in use
 extern void stb_vorbis_close(stb_vorbis *f);
 
+#ifdef STB_VORBIS_SETUP_CACHE
+// free the cached setup tables that no open handle uses anymore
+extern void stb_vorbis_flush_setup_cache(void);
+#endif
+
 // this function returns the offset (in samples) from the beginning of the
 // file that will be returned by the next decode, if it is known, or -1
 // otherwise. after a flush_pushdata() call, this may take a while before
@@ -295,6 +300,24 @@ extern stb_vorbis * stb_vorbis_open_file_section(FILE *f, int close_handle_on_cl
 // confused.
 #endif
 
+#ifdef STB_VORBIS_IO_CALLBACKS
+typedef struct
+{
+   void *user;
+   // copy up to 'size' bytes from 'offset' (relative to the start of the
+   // stream) into 'data', return the number copied (less only at the end)
+   int (*read)(void *user, unsigned int offset, unsigned char *data, int size);
+} stb_vorbis_io;
+
+extern stb_vorbis * stb_vorbis_open_io(const stb_vorbis_io *io, unsigned int len,
+                                  int *error, const stb_vorbis_alloc *alloc_buffer);
+// create an ogg vorbis decoder reading a stream of 'len' bytes through 'io'.
+// reads go through a STB_VORBIS_IO_BUFFER byte buffer inside the decoder and
+// are always positioned, so several decoders can share one source. 'io' is
+// copied; io->user must stay valid until the decoder is closed. on failure,
+// returns NULL and sets *error.
+#endif
+
 extern int stb_vorbis_seek_frame(stb_vorbis *f, unsigned int sample_number);
 extern int stb_vorbis_seek(stb_vorbis *f, unsigned int sample_number);
 // these functions seek in the Vorbis file to (approximately) 'sample_number'.
@@ -307,6 +330,24 @@ extern int stb_vorbis_seek(stb_vorbis *f, unsigned int sample_number);
 extern int stb_vorbis_seek_start(stb_vorbis *f);
 // this function is equivalent to stb_vorbis_seek(f,0)
 
+typedef struct
+{
+   unsigned int page_start, page_end;   // file offsets
+   unsigned int last_decoded_sample;    // granule position of the page
+} stb_vorbis_seek_point;
+
+extern int stb_vorbis_build_seek_index(stb_vorbis *f, stb_vorbis_seek_point *index, int max_points);
+// scans every page of the stream and stores a point for each page on which
+// a frame ends, then seeks back to the start. returns the number of points
+// the stream has, which can be more than max_points (index may be NULL to
+// just count them).
+
+extern void stb_vorbis_set_seek_index(stb_vorbis *f, const stb_vorbis_seek_point *index, int num_points);
+// makes the seek functions look the page up in 'index' instead of bisecting
+// the file, so a seek costs one page read plus the pre-roll. the index must
+// come from the same stream and stay valid until it is replaced (NULL goes
+// back to bisecting) or the decoder is closed.
+
 extern unsigned int stb_vorbis_stream_length_in_samples(stb_vorbis *f);
 extern float        stb_vorbis_stream_length_in_seconds(stb_vorbis *f);
 // these functions return the total length of the vorbis stream
@@ -448,6 +489,39 @@ enum STBVorbisError
 //      most platforms which requires endianness be defined correctly.
 //#define STB_VORBIS_NO_FAST_SCALED_FLOAT
 
+// STB_VORBIS_NO_SIMD
+//      does not use the SSE/AVX/NEON versions of the inverse MDCT
+//      butterflies and of the float to short conversion/interleaving.
+//      The scalar code is the reference; the SIMD paths do
+//      the same float operations in the same order and produce the same
+//      bits (as long as the compiler doesn't contract the scalar code
+//      into fused multiply-adds).
+//#define STB_VORBIS_NO_SIMD
+
+// STB_VORBIS_SETUP_CACHE
+//      share the codebooks, floor/residue/mapping configs and the
+//      per-blocksize tables between handles whose setup headers are
+//      byte-identical (files from the same encoder settings), so opening
+//      another handle only decodes the small per-handle state. Entries are
+//      refcounted and stay cached after the last handle closes, until
+//      stb_vorbis_flush_setup_cache(). Handles opened with an alloc_buffer
+//      use cached tables but never add them, and setup_memory_required
+//      leaves out cached tables. Must be defined for both the header and
+//      the implementation.
+//#define STB_VORBIS_SETUP_CACHE
+
+// STB_VORBIS_IO_CALLBACKS
+//      adds stb_vorbis_open_io(), which pulls the stream through a read
+//      callback instead of a FILE * or a memory block. Must be defined
+//      for both the header and the implementation.
+//#define STB_VORBIS_IO_CALLBACKS
+
+// STB_VORBIS_IO_BUFFER [number]
+//      size of the buffer between the io callback and the decoder.
+#ifndef STB_VORBIS_IO_BUFFER
+#define STB_VORBIS_IO_BUFFER 4096
+#endif
+
 
 // STB_VORBIS_MAX_CHANNELS [number]
 //     globally define this to the maximum number of channels you need.
@@ -600,6 +674,24 @@ enum STBVorbisError
 
 #include <limits.h>
 
+#ifndef STB_VORBIS_NO_SIMD
+   #if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+      #define STB_VORBIS_SSE
+      #include <xmmintrin.h>
+      #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+         #define STB_VORBIS_SSE2
+         #include <emmintrin.h>
+      #endif
+      #ifdef __AVX__
+         #define STB_VORBIS_AVX
+         #include <immintrin.h>
+      #endif
+   #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      #define STB_VORBIS_NEON
+      #include <arm_neon.h>
+   #endif
+#endif
+
 #ifdef __MINGW32__
    // eff you mingw:
    //     "fixed":
@@ -782,6 +874,39 @@ typedef struct
    uint32 last_decoded_sample;
 } ProbedPage;
 
+#ifdef STB_VORBIS_SETUP_CACHE
+// immutable tables built from one setup header
+typedef struct SetupCache
+{
+   struct SetupCache *next;
+   int refcount;
+
+   // key
+   uint32 crc;
+   uint8 *packet;
+   int packet_len;
+   int channels, blocksize_0, blocksize_1;
+
+   unsigned int setup_temp_memory_required;
+   int longest_floorlist;
+   int codebook_count;
+   Codebook *codebooks;
+   int floor_count;
+   uint16 floor_types[64];
+   Floor *floor_config;
+   int residue_count;
+   uint16 residue_types[64];
+   Residue *residue_config;
+   int mapping_count;
+   Mapping *mapping;
+   int mode_count;
+   Mode mode_config[64];
+   float *A[2],*B[2],*C[2];
+   float *window[2];
+   uint16 *bit_reverse[2];
+} SetupCache;
+#endif
+
 struct stb_vorbis
 {
   // user-accessible info
@@ -803,6 +928,13 @@ struct stb_vorbis
    int close_on_free;
 #endif
 
+#ifdef STB_VORBIS_IO_CALLBACKS
+   stb_vorbis_io io;
+   uint32 io_offset;           // stream offset of io_buffer[0]
+   int io_pos, io_len;
+   uint8 io_buffer[STB_VORBIS_IO_BUFFER];
+#endif
+
    uint8 *stream;
    uint8 *stream_start;
    uint8 *stream_end;
@@ -818,6 +950,10 @@ struct stb_vorbis
    // (but not necessarily the page on which it starts)
    ProbedPage p_first, p_last;
 
+   // pages to seek with, owned by the caller
+   const stb_vorbis_seek_point *seek_index;
+   int seek_index_count;
+
   // memory management
    stb_vorbis_alloc alloc;
    int setup_offset;
@@ -870,6 +1006,15 @@ struct stb_vorbis
    float *window[2];
    uint16 *bit_reverse[2];
 
+   #ifdef STB_VORBIS_SETUP_CACHE
+   // the tables above point into this entry when it is set
+   SetupCache *setup_cache;
+   // setup packet captured on a cache miss, until the entry is added
+   uint8 *setup_packet;
+   int setup_packet_len;
+   uint32 setup_crc;
+   #endif
+
   // current page/packet/segment streaming info
    uint32 serial; // stream serial number for verification
    int last_page;
@@ -1334,8 +1479,33 @@ static int STBV_CDECL point_compare(const void *p, const void *q)
    #define USE_MEMORY(z)    ((z)->stream)
 #endif
 
+#ifdef STB_VORBIS_IO_CALLBACKS
+#define USE_IO(z)    ((z)->io.read)
+
+static int io_fill(vorb *z)
+{
+   z->io_offset += z->io_len;
+   z->io_pos = 0;
+   z->io_len = 0;
+   if (z->io_offset < z->stream_len) {
+      uint32 n = z->stream_len - z->io_offset;
+      if (n > STB_VORBIS_IO_BUFFER) n = STB_VORBIS_IO_BUFFER;
+      z->io_len = z->io.read(z->io.user, z->io_offset, z->io_buffer, (int) n);
+      if (z->io_len < 0) z->io_len = 0;
+   }
+   return z->io_len > 0;
+}
+#endif
+
 static uint8 get8(vorb *z)
 {
+   #ifdef STB_VORBIS_IO_CALLBACKS
+   if (USE_IO(z)) {
+      if (z->io_pos == z->io_len && !io_fill(z)) { z->eof = TRUE; return 0; }
+      return z->io_buffer[z->io_pos++];
+   }
+   #endif
+
    if (USE_MEMORY(z)) {
       if (z->stream >= z->stream_end) { z->eof = TRUE; return 0; }
       return *z->stream++;
@@ -1362,6 +1532,24 @@ static uint32 get32(vorb *f)
 
 static int getn(vorb *z, uint8 *data, int n)
 {
+   #ifdef STB_VORBIS_IO_CALLBACKS
+   if (USE_IO(z)) {
+      while (n > 0) {
+         int k = z->io_len - z->io_pos;
+         if (k == 0) {
+            if (!io_fill(z)) { z->eof = 1; return 0; }
+            continue;
+         }
+         if (k > n) k = n;
+         memcpy(data, z->io_buffer + z->io_pos, k);
+         z->io_pos += k;
+         data += k;
+         n -= k;
+      }
+      return 1;
+   }
+   #endif
+
    if (USE_MEMORY(z)) {
       if (z->stream+n > z->stream_end) { z->eof = 1; return 0; }
       memcpy(data, z->stream, n);
@@ -1381,6 +1569,19 @@ static int getn(vorb *z, uint8 *data, int n)
 
 static void skip(vorb *z, int n)
 {
+   #ifdef STB_VORBIS_IO_CALLBACKS
+   if (USE_IO(z)) {
+      uint32 loc = z->io_offset + z->io_pos + n;
+      if (loc >= z->stream_len) z->eof = 1;
+      if (n < z->io_len - z->io_pos) {
+         z->io_pos += n;
+      } else {
+         z->io_offset = loc;
+         z->io_pos = z->io_len = 0;
+      }
+      return;
+   }
+   #endif
    if (USE_MEMORY(z)) {
       z->stream += n;
       if (z->stream >= z->stream_end) z->eof = 1;
@@ -1400,6 +1601,24 @@ static int set_file_offset(stb_vorbis *f, unsigned int loc)
    if (f->push_mode) return 0;
    #endif
    f->eof = 0;
+   #ifdef STB_VORBIS_IO_CALLBACKS
+   if (USE_IO(f)) {
+      if (loc >= f->stream_len) {
+         f->io_offset = f->stream_len;
+         f->io_pos = f->io_len = 0;
+         f->eof = 1;
+         return 0;
+      }
+      // keep the buffer when the target is in it
+      if (loc >= f->io_offset && loc < f->io_offset + f->io_len) {
+         f->io_pos = loc - f->io_offset;
+      } else {
+         f->io_offset = loc;
+         f->io_pos = f->io_len = 0;
+      }
+      return 1;
+   }
+   #endif
    if (USE_MEMORY(f)) {
       if (f->stream_start + loc >= f->stream_end || f->stream_start + loc < f->stream_start) {
          f->stream = f->stream_end;
@@ -2405,6 +2624,70 @@ void inverse_mdct(float *buffer, int n, vorb *f, int blocktype)
 // the following were split out into separate functions while optimizing;
 // they could be pushed back up but eh. __forceinline showed no change;
 // they're probably already being inlined.
+//
+// the SIMD versions handle two (SSE/NEON) or four (AVX) of the complex
+// pairs below per instruction. A pair is stored as { e[-1], e[0] } =
+// { im, re } walking downwards, so a 4-float load at e-3 holds pairs 1
+// and 0 as { im1, re1, im0, re0 }. The rotation
+//    re' = re*A[0] - im*A[1],   im' = im*A[0] + re*A[1]
+// becomes k*c + swap(k)*s with c = { A[0] } and s = { A[1], -A[1] }
+// per pair, which rounds exactly like the scalar code.
+#if defined(STB_VORBIS_SSE)
+static __forceinline void imdct_twiddle2(float *A0, float *A1, __m128 *c, __m128 *s)
+{
+   __m128 t = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (__m64 *) A1), (__m64 *) A0);
+   *c = _mm_shuffle_ps(t, t, _MM_SHUFFLE(2,2,0,0));
+   *s = _mm_xor_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(3,3,1,1)), _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f));
+}
+
+static __forceinline void imdct_butterfly2(float *e0, float *e2, __m128 c, __m128 s)
+{
+   __m128 a = _mm_loadu_ps(e0-3);
+   __m128 b = _mm_loadu_ps(e2-3);
+   __m128 k = _mm_sub_ps(a, b);
+   _mm_storeu_ps(e0-3, _mm_add_ps(a, b));
+   _mm_storeu_ps(e2-3, _mm_add_ps(_mm_mul_ps(k, c), _mm_mul_ps(_mm_shuffle_ps(k, k, _MM_SHUFFLE(2,3,0,1)), s)));
+}
+#elif defined(STB_VORBIS_NEON)
+static __forceinline void imdct_twiddle2(float *A0, float *A1, float32x4_t *c, float32x4_t *s)
+{
+   static const float sign[4] = { 1.0f, -1.0f, 1.0f, -1.0f };
+   float32x4x2_t t = vtrnq_f32(vcombine_f32(vld1_f32(A1), vld1_f32(A0)), vcombine_f32(vld1_f32(A1), vld1_f32(A0)));
+   *c = t.val[0];
+   *s = vmulq_f32(t.val[1], vld1q_f32(sign));
+}
+
+static __forceinline void imdct_butterfly2(float *e0, float *e2, float32x4_t c, float32x4_t s)
+{
+   float32x4_t a = vld1q_f32(e0-3);
+   float32x4_t b = vld1q_f32(e2-3);
+   float32x4_t k = vsubq_f32(a, b);
+   vst1q_f32(e0-3, vaddq_f32(a, b));
+   vst1q_f32(e2-3, vaddq_f32(vmulq_f32(k, c), vmulq_f32(vrev64q_f32(k), s)));
+}
+#endif
+
+#if defined(STB_VORBIS_AVX)
+// pairs 3,2 in the low half and 1,0 in the high half
+static __forceinline void imdct_twiddle4(float *A0, float *A1, float *A2, float *A3, __m256 *c, __m256 *s)
+{
+   __m128 c0,s0,c1,s1;
+   imdct_twiddle2(A2, A3, &c0, &s0);
+   imdct_twiddle2(A0, A1, &c1, &s1);
+   *c = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c1, 1);
+   *s = _mm256_insertf128_ps(_mm256_castps128_ps256(s0), s1, 1);
+}
+
+static __forceinline void imdct_butterfly4(float *e0, float *e2, __m256 c, __m256 s)
+{
+   __m256 a = _mm256_loadu_ps(e0-7);
+   __m256 b = _mm256_loadu_ps(e2-7);
+   __m256 k = _mm256_sub_ps(a, b);
+   _mm256_storeu_ps(e0-7, _mm256_add_ps(a, b));
+   _mm256_storeu_ps(e2-7, _mm256_add_ps(_mm256_mul_ps(k, c), _mm256_mul_ps(_mm256_permute_ps(k, _MM_SHUFFLE(2,3,0,1)), s)));
+}
+#endif
+
 static void imdct_step3_iter0_loop(int n, float *e, int i_off, int k_off, float *A)
 {
    float *ee0 = e + i_off;
@@ -2412,6 +2695,31 @@ static void imdct_step3_iter0_loop(int n, float *e, int i_off, int k_off, float
    int i;
 
    assert((n & 3) == 0);
+#if defined(STB_VORBIS_AVX)
+   for (i=(n>>2); i > 0; --i) {
+      __m256 c,s;
+      imdct_twiddle4(A, A+8, A+16, A+24, &c, &s);
+      imdct_butterfly4(ee0, ee2, c, s);
+      A += 32;
+      ee0 -= 8;
+      ee2 -= 8;
+   }
+#elif defined(STB_VORBIS_SSE) || defined(STB_VORBIS_NEON)
+   for (i=(n>>2); i > 0; --i) {
+      #ifdef STB_VORBIS_SSE
+      __m128 c,s;
+      #else
+      float32x4_t c,s;
+      #endif
+      imdct_twiddle2(A, A+8, &c, &s);
+      imdct_butterfly2(ee0, ee2, c, s);
+      imdct_twiddle2(A+16, A+24, &c, &s);
+      imdct_butterfly2(ee0-4, ee2-4, c, s);
+      A += 32;
+      ee0 -= 8;
+      ee2 -= 8;
+   }
+#else
    for (i=(n>>2); i > 0; --i) {
       float k00_20, k01_21;
       k00_20  = ee0[ 0] - ee2[ 0];
@@ -2448,17 +2756,43 @@ static void imdct_step3_iter0_loop(int n, float *e, int i_off, int k_off, float
       ee0 -= 8;
       ee2 -= 8;
    }
+#endif
 }
 
 static void imdct_step3_inner_r_loop(int lim, float *e, int d0, int k_off, float *A, int k1)
 {
    int i;
-   float k00_20, k01_21;
 
    float *e0 = e + d0;
    float *e2 = e0 + k_off;
 
+#if defined(STB_VORBIS_AVX)
+   for (i=lim >> 2; i > 0; --i) {
+      __m256 c,s;
+      imdct_twiddle4(A, A+k1, A+k1*2, A+k1*3, &c, &s);
+      imdct_butterfly4(e0, e2, c, s);
+      e0 -= 8;
+      e2 -= 8;
+      A += k1*4;
+   }
+#elif defined(STB_VORBIS_SSE) || defined(STB_VORBIS_NEON)
    for (i=lim >> 2; i > 0; --i) {
+      #ifdef STB_VORBIS_SSE
+      __m128 c,s;
+      #else
+      float32x4_t c,s;
+      #endif
+      imdct_twiddle2(A, A+k1, &c, &s);
+      imdct_butterfly2(e0, e2, c, s);
+      imdct_twiddle2(A+k1*2, A+k1*3, &c, &s);
+      imdct_butterfly2(e0-4, e2-4, c, s);
+      e0 -= 8;
+      e2 -= 8;
+      A += k1*4;
+   }
+#else
+   for (i=lim >> 2; i > 0; --i) {
+      float k00_20, k01_21;
       k00_20 = e0[-0] - e2[-0];
       k01_21 = e0[-1] - e2[-1];
       e0[-0] += e2[-0];//e0[-0] = e0[-0] + e2[-0];
@@ -2498,11 +2832,39 @@ static void imdct_step3_inner_r_loop(int lim, float *e, int d0, int k_off, float
 
       A += k1;
    }
+#endif
 }
 
 static void imdct_step3_inner_s_loop(int n, float *e, int i_off, int k_off, float *A, int a_off, int k0)
 {
    int i;
+#if defined(STB_VORBIS_AVX)
+   float *ee0 = e  +i_off;
+   float *ee2 = ee0+k_off;
+   __m256 c,s;
+   imdct_twiddle4(A, A+a_off, A+a_off*2, A+a_off*3, &c, &s);
+   for (i=n; i > 0; --i) {
+      imdct_butterfly4(ee0, ee2, c, s);
+      ee0 -= k0;
+      ee2 -= k0;
+   }
+#elif defined(STB_VORBIS_SSE) || defined(STB_VORBIS_NEON)
+   float *ee0 = e  +i_off;
+   float *ee2 = ee0+k_off;
+   #ifdef STB_VORBIS_SSE
+   __m128 c0,s0,c1,s1;
+   #else
+   float32x4_t c0,s0,c1,s1;
+   #endif
+   imdct_twiddle2(A, A+a_off, &c0, &s0);
+   imdct_twiddle2(A+a_off*2, A+a_off*3, &c1, &s1);
+   for (i=n; i > 0; --i) {
+      imdct_butterfly2(ee0, ee2, c0, s0);
+      imdct_butterfly2(ee0-4, ee2-4, c1, s1);
+      ee0 -= k0;
+      ee2 -= k0;
+   }
+#else
    float A0 = A[0];
    float A1 = A[0+1];
    float A2 = A[0+a_off];
@@ -2549,6 +2911,7 @@ static void imdct_step3_inner_s_loop(int n, float *e, int i_off, int k_off, floa
       ee0 -= k0;
       ee2 -= k0;
    }
+#endif
 }
 
 static __forceinline void iter_54(float *z)
@@ -3577,11 +3940,19 @@ static int is_whole_packet_present(stb_vorbis *f)
 }
 #endif // !STB_VORBIS_NO_PUSHDATA_API
 
+#ifdef STB_VORBIS_SETUP_CACHE
+static int setup_cache_lookup(vorb *f);
+static void setup_cache_insert(vorb *f, int longest_floorlist, unsigned int table_memory);
+#endif
+
 static int start_decoder(vorb *f)
 {
    uint8 header[6], x,y;
    int len,i,j,k, max_submaps = 0;
    int longest_floorlist=0;
+   #ifdef STB_VORBIS_SETUP_CACHE
+   unsigned int table_memory=0;
+   #endif
 
    // first page, first packet
    f->first_decode = TRUE;
@@ -3706,6 +4077,14 @@ static int start_decoder(vorb *f)
 
    crc32_init(); // always init it, to avoid multithread race conditions
 
+   #ifdef STB_VORBIS_SETUP_CACHE
+   if (setup_cache_lookup(f)) {
+      longest_floorlist = f->setup_cache->longest_floorlist;
+      goto setup_done;
+   }
+   table_memory = f->setup_memory_required;
+   #endif
+
    if (get8_packet(f) != VORBIS_packet_setup)       return error(f, VORBIS_invalid_setup);
    for (i=0; i < 6; ++i) header[i] = get8_packet(f);
    if (!vorbis_validate(header))                    return error(f, VORBIS_invalid_setup);
@@ -4126,6 +4505,10 @@ static int start_decoder(vorb *f)
 
    flush_packet(f);
 
+  #ifdef STB_VORBIS_SETUP_CACHE
+   table_memory = f->setup_memory_required - table_memory;
+  setup_done:
+  #endif
    f->previous_length = 0;
 
    for (i=0; i < f->channels; ++i) {
@@ -4140,8 +4523,20 @@ static int start_decoder(vorb *f)
       #endif
    }
 
-   if (!init_blocksize(f, 0, f->blocksize_0)) return FALSE;
-   if (!init_blocksize(f, 1, f->blocksize_1)) return FALSE;
+   #ifdef STB_VORBIS_SETUP_CACHE
+   if (!f->setup_cache)
+   #endif
+   {
+      #ifdef STB_VORBIS_SETUP_CACHE
+      table_memory -= f->setup_memory_required;
+      #endif
+      if (!init_blocksize(f, 0, f->blocksize_0)) return FALSE;
+      if (!init_blocksize(f, 1, f->blocksize_1)) return FALSE;
+      #ifdef STB_VORBIS_SETUP_CACHE
+      table_memory += f->setup_memory_required;
+      setup_cache_insert(f, longest_floorlist, table_memory);
+      #endif
+   }
    f->blocksize[0] = f->blocksize_0;
    f->blocksize[1] = f->blocksize_1;
 
@@ -4205,16 +4600,11 @@ static int start_decoder(vorb *f)
    return TRUE;
 }
 
-static void vorbis_deinit(stb_vorbis *p)
+// frees the tables built from the setup header
+static void vorbis_free_setup(stb_vorbis *p)
 {
    int i,j;
 
-   setup_free(p, p->vendor);
-   for (i=0; i < p->comment_list_length; ++i) {
-      setup_free(p, p->comment_list[i]);
-   }
-   setup_free(p, p->comment_list);
-
    if (p->residue_config) {
       for (i=0; i < p->residue_count; ++i) {
          Residue *r = p->residue_config+i;
@@ -4247,6 +4637,218 @@ static void vorbis_deinit(stb_vorbis *p)
          setup_free(p, p->mapping[i].chan);
       setup_free(p, p->mapping);
    }
+   for (i=0; i < 2; ++i) {
+      setup_free(p, p->A[i]);
+      setup_free(p, p->B[i]);
+      setup_free(p, p->C[i]);
+      setup_free(p, p->window[i]);
+      setup_free(p, p->bit_reverse[i]);
+   }
+}
+
+#ifdef STB_VORBIS_SETUP_CACHE
+static SetupCache *setup_cache_list;
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static volatile long setup_cache_spin;
+#define setup_cache_lock()    while (_InterlockedExchange(&setup_cache_spin, 1)) {}
+#define setup_cache_unlock()  _InterlockedExchange(&setup_cache_spin, 0)
+#else
+static volatile int setup_cache_spin;
+#define setup_cache_lock()    while (__sync_lock_test_and_set(&setup_cache_spin, 1)) {}
+#define setup_cache_unlock()  __sync_lock_release(&setup_cache_spin)
+#endif
+
+static int setup_cache_match(SetupCache *c, vorb *f, uint8 *packet, int len, uint32 crc)
+{
+   return c->crc == crc && c->packet_len == len && c->channels == f->channels &&
+          c->blocksize_0 == f->blocksize_0 && c->blocksize_1 == f->blocksize_1 &&
+          !memcmp(c->packet, packet, len);
+}
+
+static void setup_cache_attach(vorb *f, SetupCache *c)
+{
+   f->setup_temp_memory_required = c->setup_temp_memory_required;
+   f->codebook_count = c->codebook_count;
+   f->codebooks = c->codebooks;
+   f->floor_count = c->floor_count;
+   memcpy(f->floor_types, c->floor_types, sizeof(f->floor_types));
+   f->floor_config = c->floor_config;
+   f->residue_count = c->residue_count;
+   memcpy(f->residue_types, c->residue_types, sizeof(f->residue_types));
+   f->residue_config = c->residue_config;
+   f->mapping_count = c->mapping_count;
+   f->mapping = c->mapping;
+   f->mode_count = c->mode_count;
+   memcpy(f->mode_config, c->mode_config, sizeof(f->mode_config));
+   memcpy(f->A, c->A, sizeof(f->A));
+   memcpy(f->B, c->B, sizeof(f->B));
+   memcpy(f->C, c->C, sizeof(f->C));
+   memcpy(f->window, c->window, sizeof(f->window));
+   memcpy(f->bit_reverse, c->bit_reverse, sizeof(f->bit_reverse));
+}
+
+static void setup_cache_free(SetupCache *c)
+{
+   vorb p;
+   memset(&p, 0, sizeof(p));
+   setup_cache_attach(&p, c);
+   vorbis_free_setup(&p);
+   free(c->packet);
+   free(c);
+}
+
+// reads the whole setup packet. on a hit the handle shares the cached
+// tables and is left past the packet, as if it had been parsed; on a
+// miss it is rewound to the start of the packet
+static int setup_cache_lookup(vorb *f)
+{
+   vorb saved;
+   unsigned int offset = stb_vorbis_get_file_offset(f);
+   uint8 *packet = NULL;
+   int len = 0, cap = 0, x;
+   uint32 crc = 0;
+   SetupCache *c;
+
+   memcpy(&saved, f, sizeof(saved));
+   while ((x = get8_packet_raw(f)) != EOP) {
+      if (len == cap) {
+         uint8 *p = (uint8 *) realloc(packet, cap = cap ? cap*2 : 4096);
+         if (!p) { free(packet); packet = NULL; break; }
+         packet = p;
+      }
+      packet[len++] = (uint8) x;
+      crc = crc32_update(crc, (uint8) x);
+   }
+
+   c = NULL;
+   if (packet && !f->eof) {
+      setup_cache_lock();
+      for (c = setup_cache_list; c; c = c->next)
+         if (setup_cache_match(c, f, packet, len, crc))
+            break;
+      if (c) ++c->refcount;
+      setup_cache_unlock();
+   }
+   if (c) {
+      free(packet);
+      setup_cache_attach(f, c);
+      f->setup_cache = c;
+      return TRUE;
+   }
+
+   memcpy(f, &saved, sizeof(saved));
+   if (!IS_PUSH_MODE(f)) set_file_offset(f, offset); // the stdio position isn't in the handle
+   if (f->alloc.alloc_buffer) {
+      // tables in the handle's own buffer can't outlive it
+      free(packet);
+      packet = NULL;
+   }
+   f->setup_packet = packet;
+   f->setup_packet_len = len;
+   f->setup_crc = crc;
+   return FALSE;
+}
+
+// hands the freshly built tables over to the cache. setup_memory_required
+// then only counts what the handle needs besides the cached tables, which
+// is what a later alloc_buffer for the same setup has to hold
+static void setup_cache_insert(vorb *f, int longest_floorlist, unsigned int table_memory)
+{
+   SetupCache *c, *e;
+   if (!f->setup_packet) return;
+   c = (SetupCache *) malloc(sizeof(*c));
+   if (!c) return;
+   c->refcount = 1;
+   c->crc = f->setup_crc;
+   c->packet = f->setup_packet;
+   c->packet_len = f->setup_packet_len;
+   c->channels = f->channels;
+   c->blocksize_0 = f->blocksize_0;
+   c->blocksize_1 = f->blocksize_1;
+   c->setup_temp_memory_required = f->setup_temp_memory_required;
+   c->longest_floorlist = longest_floorlist;
+   c->codebook_count = f->codebook_count;
+   c->codebooks = f->codebooks;
+   c->floor_count = f->floor_count;
+   memcpy(c->floor_types, f->floor_types, sizeof(c->floor_types));
+   c->floor_config = f->floor_config;
+   c->residue_count = f->residue_count;
+   memcpy(c->residue_types, f->residue_types, sizeof(c->residue_types));
+   c->residue_config = f->residue_config;
+   c->mapping_count = f->mapping_count;
+   c->mapping = f->mapping;
+   c->mode_count = f->mode_count;
+   memcpy(c->mode_config, f->mode_config, sizeof(c->mode_config));
+   memcpy(c->A, f->A, sizeof(c->A));
+   memcpy(c->B, f->B, sizeof(c->B));
+   memcpy(c->C, f->C, sizeof(c->C));
+   memcpy(c->window, f->window, sizeof(c->window));
+   memcpy(c->bit_reverse, f->bit_reverse, sizeof(c->bit_reverse));
+
+   setup_cache_lock();
+   for (e = setup_cache_list; e; e = e->next)
+      if (setup_cache_match(e, f, c->packet, c->packet_len, c->crc))
+         break;
+   if (!e) {
+      c->next = setup_cache_list;
+      setup_cache_list = c;
+   }
+   setup_cache_unlock();
+
+   if (e) {
+      // another handle added the same setup first, keep ours private
+      free(c);
+      return;
+   }
+   f->setup_packet = NULL;
+   f->setup_cache = c;
+   f->setup_memory_required -= table_memory;
+}
+
+void stb_vorbis_flush_setup_cache(void)
+{
+   SetupCache **p, *c, *unused = NULL;
+   setup_cache_lock();
+   for (p = &setup_cache_list; *p; ) {
+      c = *p;
+      if (c->refcount == 0) {
+         *p = c->next;
+         c->next = unused;
+         unused = c;
+      } else
+         p = &c->next;
+   }
+   setup_cache_unlock();
+   while (unused) {
+      c = unused;
+      unused = c->next;
+      setup_cache_free(c);
+   }
+}
+#endif
+
+static void vorbis_deinit(stb_vorbis *p)
+{
+   int i;
+
+   setup_free(p, p->vendor);
+   for (i=0; i < p->comment_list_length; ++i) {
+      setup_free(p, p->comment_list[i]);
+   }
+   setup_free(p, p->comment_list);
+
+   #ifdef STB_VORBIS_SETUP_CACHE
+   free(p->setup_packet);
+   if (p->setup_cache) {
+      setup_cache_lock();
+      --p->setup_cache->refcount;
+      setup_cache_unlock();
+   } else
+   #endif
+   vorbis_free_setup(p);
+
    CHECK(p);
    for (i=0; i < p->channels && i < STB_VORBIS_MAX_CHANNELS; ++i) {
       setup_free(p, p->channel_buffers[i]);
@@ -4256,13 +4858,6 @@ static void vorbis_deinit(stb_vorbis *p)
       #endif
       setup_free(p, p->finalY[i]);
    }
-   for (i=0; i < 2; ++i) {
-      setup_free(p, p->A[i]);
-      setup_free(p, p->B[i]);
-      setup_free(p, p->C[i]);
-      setup_free(p, p->window[i]);
-      setup_free(p, p->bit_reverse[i]);
-   }
    #ifndef STB_VORBIS_NO_STDIO
    if (p->close_on_free) fclose(p->f);
    #endif
@@ -4547,6 +5142,9 @@ unsigned int stb_vorbis_get_file_offset(stb_vorbis *f)
    #ifndef STB_VORBIS_NO_PUSHDATA_API
    if (f->push_mode) return 0;
    #endif
+   #ifdef STB_VORBIS_IO_CALLBACKS
+   if (USE_IO(f)) return f->io_offset + f->io_pos;
+   #endif
    if (USE_MEMORY(f)) return (unsigned int) (f->stream - f->stream_start);
    #ifndef STB_VORBIS_NO_STDIO
    return (unsigned int) (ftell(f->f) - f->f_start);
@@ -4739,6 +5337,22 @@ static int seek_to_sample_coarse(stb_vorbis *f, uint32 sample_number)
       return 0;
    }
 
+   if (f->seek_index) {
+      // last indexed page that ends at or before the limit
+      int lo = 0, hi = f->seek_index_count-1;
+      while (lo < hi) {
+         int m = (lo + hi + 1) >> 1;
+         if (f->seek_index[m].last_decoded_sample <= last_sample_limit)
+            lo = m;
+         else
+            hi = m - 1;
+      }
+      left.page_start = f->seek_index[lo].page_start;
+      left.page_end = f->seek_index[lo].page_end;
+      left.last_decoded_sample = f->seek_index[lo].last_decoded_sample;
+      right.page_start = left.page_end; // nothing left to search
+   }
+
    while (left.page_end != right.page_start) {
       assert(left.page_end < right.page_start);
       // search range in bytes
@@ -4933,6 +5547,38 @@ int stb_vorbis_seek(stb_vorbis *f, unsigned int sample_number)
    return 1;
 }
 
+int stb_vorbis_build_seek_index(stb_vorbis *f, stb_vorbis_seek_point *index, int max_points)
+{
+   ProbedPage page;
+   unsigned int offset, end;
+   int n = 0;
+
+   if (IS_PUSH_MODE(f)) return error(f, VORBIS_invalid_api_mixing);
+   if (!stb_vorbis_stream_length_in_samples(f)) return error(f, VORBIS_seek_without_length);
+
+   end = f->p_last.page_end;
+   for (offset = f->p_first.page_start; offset < end; offset = page.page_end) {
+      set_file_offset(f, offset);
+      if (!get_seek_page_info(f, &page) || f->eof) break;
+      if (page.last_decoded_sample == ~0U) continue; // no frame ends here
+      if (n < max_points) {
+         index[n].page_start = page.page_start;
+         index[n].page_end = page.page_end;
+         index[n].last_decoded_sample = page.last_decoded_sample;
+      }
+      ++n;
+   }
+
+   stb_vorbis_seek_start(f);
+   return n;
+}
+
+void stb_vorbis_set_seek_index(stb_vorbis *f, const stb_vorbis_seek_point *index, int num_points)
+{
+   f->seek_index = num_points > 0 ? index : NULL;
+   f->seek_index_count = num_points;
+}
+
 int stb_vorbis_seek_start(stb_vorbis *f)
 {
    if (IS_PUSH_MODE(f)) { return error(f, VORBIS_invalid_api_mixing); }
@@ -5096,6 +5742,31 @@ stb_vorbis * stb_vorbis_open_filename(const char *filename, int *error, const st
 }
 #endif // STB_VORBIS_NO_STDIO
 
+#ifdef STB_VORBIS_IO_CALLBACKS
+stb_vorbis * stb_vorbis_open_io(const stb_vorbis_io *io, unsigned int len, int *error, const stb_vorbis_alloc *alloc)
+{
+   stb_vorbis *f, p;
+   if (io == NULL || io->read == NULL) {
+      if (error) *error = VORBIS_unexpected_eof;
+      return NULL;
+   }
+   vorbis_init(&p, alloc);
+   p.io = *io;
+   p.stream_len = len;
+   if (start_decoder(&p)) {
+      f = vorbis_alloc(&p);
+      if (f) {
+         *f = p;
+         vorbis_pump_first_frame(f);
+         return f;
+      }
+   }
+   if (error) *error = p.error;
+   vorbis_deinit(&p);
+   return NULL;
+}
+#endif // STB_VORBIS_IO_CALLBACKS
+
 stb_vorbis * stb_vorbis_open_memory(const unsigned char *data, int len, int *error, const stb_vorbis_alloc *alloc)
 {
    stb_vorbis *f, p;
@@ -5162,11 +5833,50 @@ static int8 channel_position[7][6] =
    #define FASTDEF(x)
 #endif
 
+// 4 lanes of FAST_SCALED_FLOAT_TO_INT(temp,x,15), bit for bit; the
+// saturating packs below match the scalar clamp
+#if defined(STB_VORBIS_SSE2)
+static __forceinline __m128i float_to_int_x4(__m128 x)
+{
+   #ifndef STB_VORBIS_NO_FAST_SCALED_FLOAT
+   return _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(x, _mm_set1_ps(MAGIC(15)))), _mm_set1_epi32(ADDEND(15)));
+   #else
+   return _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps((float) (1 << 15))));
+   #endif
+}
+
+static __forceinline __m128i float_to_short_x8(float *src)
+{
+   return _mm_packs_epi32(float_to_int_x4(_mm_loadu_ps(src)), float_to_int_x4(_mm_loadu_ps(src+4)));
+}
+#elif defined(STB_VORBIS_NEON)
+static __forceinline int32x4_t float_to_int_x4(float32x4_t x)
+{
+   #ifndef STB_VORBIS_NO_FAST_SCALED_FLOAT
+   return vsubq_s32(vreinterpretq_s32_f32(vaddq_f32(x, vdupq_n_f32(MAGIC(15)))), vdupq_n_s32(ADDEND(15)));
+   #else
+   return vcvtq_s32_f32(vmulq_n_f32(x, (float) (1 << 15)));
+   #endif
+}
+
+static __forceinline int16x8_t float_to_short_x8(float *src)
+{
+   return vcombine_s16(vqmovn_s32(float_to_int_x4(vld1q_f32(src))), vqmovn_s32(float_to_int_x4(vld1q_f32(src+4))));
+}
+#endif
+
 static void copy_samples(short *dest, float *src, int len)
 {
-   int i;
+   int i=0;
    check_endianness();
-   for (i=0; i < len; ++i) {
+#if defined(STB_VORBIS_SSE2)
+   for (; i+8 <= len; i += 8)
+      _mm_storeu_si128((__m128i *) (dest+i), float_to_short_x8(src+i));
+#elif defined(STB_VORBIS_NEON)
+   for (; i+8 <= len; i += 8)
+      vst1q_s16(dest+i, float_to_short_x8(src+i));
+#endif
+   for (; i < len; ++i) {
       FASTDEF(temp);
       int v = FAST_SCALED_FLOAT_TO_INT(temp, src[i],15);
       if ((unsigned int) (v + 32768) > 65535)
@@ -5190,13 +5900,7 @@ static void compute_samples(int mask, short *output, int num_c, float **data, in
                buffer[i] += data[j][d_offset+o+i];
          }
       }
-      for (i=0; i < n; ++i) {
-         FASTDEF(temp);
-         int v = FAST_SCALED_FLOAT_TO_INT(temp,buffer[i],15);
-         if ((unsigned int) (v + 32768) > 65535)
-            v = v < 0 ? -32768 : 32767;
-         output[o+i] = v;
-      }
+      copy_samples(output+o, buffer, n);
    }
    #undef STB_BUFFER_SIZE
 }
@@ -5230,13 +5934,7 @@ static void compute_stereo_samples(short *output, int num_c, float **data, int d
             }
          }
       }
-      for (i=0; i < (n<<1); ++i) {
-         FASTDEF(temp);
-         int v = FAST_SCALED_FLOAT_TO_INT(temp,buffer[i],15);
-         if ((unsigned int) (v + 32768) > 65535)
-            v = v < 0 ? -32768 : 32767;
-         output[o2+i] = v;
-      }
+      copy_samples(output+o2, buffer, n<<1);
    }
    #undef STB_BUFFER_SIZE
 }
@@ -5275,10 +5973,31 @@ static void convert_channels_short_interleaved(int buf_c, short *buffer, int dat
       assert(buf_c == 2);
       for (i=0; i < buf_c; ++i)
          compute_stereo_samples(buffer, data_c, data, d_offset, len);
+   } else if (buf_c == 1 && data_c >= 1) {
+      copy_samples(buffer, data[0]+d_offset, len);
    } else {
       int limit = buf_c < data_c ? buf_c : data_c;
-      int j;
-      for (j=0; j < len; ++j) {
+      int j=0;
+      #if defined(STB_VORBIS_SSE2)
+      if (buf_c == 2 && limit == 2) {
+         for (; j+8 <= len; j += 8, buffer += 16) {
+            __m128i l = float_to_short_x8(data[0]+d_offset+j);
+            __m128i r = float_to_short_x8(data[1]+d_offset+j);
+            _mm_storeu_si128((__m128i *) buffer, _mm_unpacklo_epi16(l, r));
+            _mm_storeu_si128((__m128i *) (buffer+8), _mm_unpackhi_epi16(l, r));
+         }
+      }
+      #elif defined(STB_VORBIS_NEON)
+      if (buf_c == 2 && limit == 2) {
+         for (; j+8 <= len; j += 8, buffer += 16) {
+            int16x8x2_t lr;
+            lr.val[0] = float_to_short_x8(data[0]+d_offset+j);
+            lr.val[1] = float_to_short_x8(data[1]+d_offset+j);
+            vst2q_s16(buffer, lr);
+         }
+      }
+      #endif
+      for (; j < len; ++j) {
          for (i=0; i < limit; ++i) {
             FASTDEF(temp);
             float f = data[i][d_offset+j];
@@ -0,0 +1,25 @@
+// decodes an OGG file to raw interleaved floats. Built once with STB_VORBIS_NO_SIMD and once without,
+// `make test` checks the scalar and SIMD inverse MDCT give bit exact output
+#include "../stb_vorbis.h"
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s in.ogg out.f32\n", argv[0]);
+        return 2;
+    }
+    int err;
+    stb_vorbis *v = stb_vorbis_open_filename(argv[1], &err, nullptr);
+    if(!v) {
+        fprintf(stderr, "%s: can't decode (%d)\n", argv[1], err);
+        return 1;
+    }
+    FILE *out = fopen(argv[2], "wb");
+    if(!out) return 1;
+    int channels = stb_vorbis_get_info(v).channels;
+    float buf[4096];
+    int n;
+    while((n = stb_vorbis_get_samples_float_interleaved(v, channels, buf, 4096)) > 0) fwrite(buf, sizeof(float), size_t(n) * channels, out);
+    fclose(out);
+    stb_vorbis_close(v);
+    return 0;
+}